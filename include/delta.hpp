@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Shortest run of the base copied instead of inserted literally
+#define DELTA_MIN_MATCH 8
+
+/**
+ * @brief Encodes a payload as text operations against a base payload
+ * Operations are comma separated: "C<offset>.<length>" copies from the base, "I<length>:<text>"
+ * inserts text. Inserted text is length prefixed, so it may contain any byte including ',' and ' '.
+ *
+ * @param base Previous payload
+ * @param target New payload
+ * @return std::string Operation list
+ */
+inline std::string delta_encode(const std::string &base, const std::string &target)
+{
+    // Index every block of the base by content, the first occurrence wins
+    std::unordered_map<std::string, size_t> blocks;
+    for (size_t i = 0; i + DELTA_MIN_MATCH <= base.size(); ++i)
+    {
+        blocks.emplace(base.substr(i, DELTA_MIN_MATCH), i);
+    }
+
+    std::string ops;
+    std::string literal;
+    auto flush_literal = [&]()
+    {
+        if (literal.empty())
+            return;
+        if (!ops.empty())
+            ops += ',';
+        ops += 'I' + std::to_string(literal.size()) + ':' + literal;
+        literal.clear();
+    };
+
+    size_t i = 0;
+    while (i < target.size())
+    {
+        auto it = i + DELTA_MIN_MATCH <= target.size() ? blocks.find(target.substr(i, DELTA_MIN_MATCH)) : blocks.end();
+        if (it == blocks.end())
+        {
+            literal += target[i++];
+            continue;
+        }
+
+        size_t offset = it->second;
+        size_t length = DELTA_MIN_MATCH;
+        while (offset + length < base.size() && i + length < target.size() && base[offset + length] == target[i + length])
+            length++;
+
+        flush_literal();
+        if (!ops.empty())
+            ops += ',';
+        ops += 'C' + std::to_string(offset) + '.' + std::to_string(length);
+        i += length;
+    }
+    flush_literal();
+
+    return ops;
+}
+
+/**
+ * @brief Rebuilds a payload from its base and an operation list of delta_encode()
+ *
+ * @param base Payload the operations refer to
+ * @param ops Operation list
+ * @param target Rebuilt payload
+ * @return true Operations were valid for the base
+ * @return false Malformed operation or copy outside of the base
+ */
+inline bool delta_apply(const std::string &base, const std::string &ops, std::string &target)
+{
+    target.clear();
+    size_t pos = 0;
+    while (pos < ops.size())
+    {
+        size_t end;
+        if (ops[pos] == 'I')
+        {
+            size_t colon = ops.find(':', pos);
+            if (colon == std::string::npos || colon == pos + 1 ||
+                ops.find_first_not_of("0123456789", pos + 1) != colon || colon - pos > 10)
+                return false;
+            size_t length = std::stoul(ops.substr(pos + 1, colon - pos - 1));
+            if (length > ops.size() - colon - 1)
+                return false;
+            target.append(ops, colon + 1, length);
+            end = colon + 1 + length;
+            if (end < ops.size() && ops[end] != ',')
+                return false;
+        }
+        else if (ops[pos] == 'C')
+        {
+            end = ops.find(',', pos);
+            if (end == std::string::npos)
+                end = ops.size();
+            size_t dot = ops.find('.', pos);
+            if (dot == std::string::npos || dot > end)
+                return false;
+            try
+            {
+                size_t offset = std::stoul(ops.substr(pos + 1, dot - pos - 1));
+                size_t length = std::stoul(ops.substr(dot + 1, end - dot - 1));
+                if (offset > base.size() || length > base.size() - offset)
+                    return false;
+                target.append(base, offset, length);
+            }
+            catch (std::exception &)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+        pos = end + 1;
+    }
+    return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <string>
+#include <zlib.h>
+
+/**
+ * @brief Raw deflate compressor priming every message with a preset dictionary
+ * The stream is reset per message, so messages decompress independently of each other
+ */
+class DictionaryCompressor
+{
+public:
+    DictionaryCompressor()
+    {
+        ready = deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+
+    ~DictionaryCompressor()
+    {
+        if (ready)
+            deflateEnd(&stream);
+    }
+
+    DictionaryCompressor(const DictionaryCompressor &) = delete;
+    DictionaryCompressor &operator=(const DictionaryCompressor &) = delete;
+
+    /**
+     * @brief Compresses one message against a dictionary
+     *
+     * @param dictionary Preset dictionary
+     * @param input Message
+     * @param output Compressed bytes
+     * @return true Message was compressed
+     * @return false Stream error
+     */
+    bool compress(const std::string &dictionary, const std::string &input, std::string &output)
+    {
+        if (!ready || deflateReset(&stream) != Z_OK)
+            return false;
+        if (deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()), dictionary.size()) != Z_OK)
+            return false;
+
+        output.resize(deflateBound(&stream, input.size()));
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+        stream.avail_in = input.size();
+        stream.next_out = reinterpret_cast<Bytef *>(&output[0]);
+        stream.avail_out = output.size();
+
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+            return false;
+        output.resize(output.size() - stream.avail_out);
+        return true;
+    }
+
+private:
+    z_stream stream{};
+    bool ready = false;
+};
+
+/**
+ * @brief Raw inflate counterpart of DictionaryCompressor
+ */
+class DictionaryDecompressor
+{
+public:
+    DictionaryDecompressor()
+    {
+        ready = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+    }
+
+    ~DictionaryDecompressor()
+    {
+        if (ready)
+            inflateEnd(&stream);
+    }
+
+    DictionaryDecompressor(const DictionaryDecompressor &) = delete;
+    DictionaryDecompressor &operator=(const DictionaryDecompressor &) = delete;
+
+    /**
+     * @brief Decompresses one message compressed against a dictionary
+     *
+     * @param dictionary Preset dictionary the message was compressed with
+     * @param input Compressed bytes
+     * @param output Message
+     * @return true Message was decompressed
+     * @return false Corrupt input or wrong dictionary
+     */
+    bool decompress(const std::string &dictionary, const std::string &input, std::string &output)
+    {
+        if (!ready || inflateReset(&stream) != Z_OK)
+            return false;
+
+        // Raw streams take the dictionary up front instead of on Z_NEED_DICT
+        if (inflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.data()), dictionary.size()) != Z_OK)
+            return false;
+
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+        stream.avail_in = input.size();
+
+        output.clear();
+        char chunk[4096];
+        int status = Z_OK;
+        while (status == Z_OK)
+        {
+            stream.next_out = reinterpret_cast<Bytef *>(chunk);
+            stream.avail_out = sizeof(chunk);
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END)
+                return false;
+            output.append(chunk, sizeof(chunk) - stream.avail_out);
+            if (status == Z_OK && stream.avail_in == 0 && stream.avail_out != 0)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    z_stream stream{};
+    bool ready = false;
+};
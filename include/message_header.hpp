@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <openssl/evp.h>
+
+#define HEADER_VERSION 1
+#define HEADER_FIXED_SIZE 16
+#define MAX_HEADER_SIZE 256
+
+/**
+ * @brief Fixed fields present in a header block
+ */
+enum HeaderFlag : uint8_t
+{
+    HeaderTtl = 1u << 0,
+    HeaderTraceId = 1u << 1,
+};
+
+/**
+ * @brief Read-only view of a header block sent in front of a payload
+ * Layout, integers little endian:
+ *   0  version        1  flags           2  block length (2 bytes)
+ *   4  ttl in ms (4)  8  trace id (8)
+ *   16 key/value fields, each a varint length and the bytes of the key, then of the value
+ * Fixed fields are read at their offsets, fields are only walked by find().
+ */
+class MessageHeaderView
+{
+public:
+    /**
+     * @brief Validates a block and binds the view to it, the block must outlive the view
+     *
+     * @param block Header block
+     * @return true Version, length and fields are well formed
+     */
+    bool parse(const std::string &block)
+    {
+        data = nullptr;
+        if (block.size() < HEADER_FIXED_SIZE || block.size() > MAX_HEADER_SIZE)
+            return false;
+
+        const auto *bytes = reinterpret_cast<const uint8_t *>(block.data());
+        if (bytes[0] != HEADER_VERSION || read_le(bytes + 2, 2) != block.size())
+            return false;
+
+        size_t offset = HEADER_FIXED_SIZE;
+        while (offset < block.size())
+        {
+            for (int part = 0; part < 2; ++part)
+            {
+                uint64_t length = 0;
+                if (!read_varint(bytes, block.size(), offset, length) || length > block.size() - offset)
+                    return false;
+                offset += length;
+            }
+        }
+
+        data = bytes;
+        size = block.size();
+        return true;
+    }
+
+    uint8_t flags() const { return data[1]; }
+    uint32_t ttl_ms() const { return (flags() & HeaderTtl) ? static_cast<uint32_t>(read_le(data + 4, 4)) : 0; }
+    uint64_t trace_id() const { return (flags() & HeaderTraceId) ? read_le(data + 8, 8) : 0; }
+
+    /**
+     * @brief Looks up a key/value field
+     *
+     * @param key Field key
+     * @param value Field value
+     * @return true Field is present
+     */
+    bool find(const std::string &key, std::string &value) const
+    {
+        size_t offset = HEADER_FIXED_SIZE;
+        while (offset < size)
+        {
+            uint64_t key_length = 0, value_length = 0;
+            read_varint(data, size, offset, key_length);
+            size_t key_offset = offset;
+            offset += key_length;
+            read_varint(data, size, offset, value_length);
+            if (key.size() == key_length && key.compare(0, key.size(), reinterpret_cast<const char *>(data + key_offset), key_length) == 0)
+            {
+                value.assign(reinterpret_cast<const char *>(data + offset), value_length);
+                return true;
+            }
+            offset += value_length;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Returns all key/value fields in block order
+     */
+    std::vector<std::pair<std::string, std::string>> fields() const
+    {
+        std::vector<std::pair<std::string, std::string>> result;
+        size_t offset = HEADER_FIXED_SIZE;
+        while (offset < size)
+        {
+            uint64_t key_length = 0, value_length = 0;
+            read_varint(data, size, offset, key_length);
+            std::string key(reinterpret_cast<const char *>(data + offset), key_length);
+            offset += key_length;
+            read_varint(data, size, offset, value_length);
+            result.emplace_back(std::move(key), std::string(reinterpret_cast<const char *>(data + offset), value_length));
+            offset += value_length;
+        }
+        return result;
+    }
+
+private:
+    static uint64_t read_le(const uint8_t *bytes, int width)
+    {
+        uint64_t value = 0;
+        for (int i = width - 1; i >= 0; --i)
+            value = (value << 8) | bytes[i];
+        return value;
+    }
+
+    static bool read_varint(const uint8_t *bytes, size_t size, size_t &offset, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; offset < size && shift < 64; shift += 7)
+        {
+            uint8_t byte = bytes[offset++];
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * @brief Builds a header block, see MessageHeaderView for the layout
+ *
+ * @param ttl_ms Time to live in ms, 0 for none
+ * @param trace_id Trace id, 0 for none
+ * @param fields Key/value fields
+ * @return std::string Header block, empty if it would exceed MAX_HEADER_SIZE
+ */
+inline std::string encode_header(uint32_t ttl_ms, uint64_t trace_id, const std::vector<std::pair<std::string, std::string>> &fields)
+{
+    std::string block(HEADER_FIXED_SIZE, '\0');
+    block[0] = HEADER_VERSION;
+    block[1] = static_cast<char>((ttl_ms ? HeaderTtl : 0) | (trace_id ? HeaderTraceId : 0));
+    for (int i = 0; i < 4; ++i)
+        block[4 + i] = static_cast<char>(ttl_ms >> (8 * i));
+    for (int i = 0; i < 8; ++i)
+        block[8 + i] = static_cast<char>(trace_id >> (8 * i));
+
+    auto write_varint = [&](uint64_t value)
+    {
+        do
+        {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            block += static_cast<char>(value ? byte | 0x80 : byte);
+        } while (value);
+    };
+    for (const auto &field : fields)
+    {
+        write_varint(field.first.size());
+        block += field.first;
+        write_varint(field.second.size());
+        block += field.second;
+    }
+
+    if (block.size() > MAX_HEADER_SIZE)
+        return "";
+    block[2] = static_cast<char>(block.size());
+    block[3] = static_cast<char>(block.size() >> 8);
+    return block;
+}
+
+/**
+ * @brief Base64 text of a header block as it travels in commands and frames
+ */
+inline std::string header_to_base64(const std::string &block)
+{
+    std::string text(4 * ((block.size() + 2) / 3), '\0');
+    int length = EVP_EncodeBlock(reinterpret_cast<unsigned char *>(&text[0]), reinterpret_cast<const unsigned char *>(block.data()), static_cast<int>(block.size()));
+    text.resize(length < 0 ? 0 : length);
+    return text;
+}
+
+/**
+ * @brief Decodes the Base64 text of a header block
+ *
+ * @param text Base64 text
+ * @param block Header block
+ * @return true Text was valid Base64
+ */
+inline bool header_from_base64(const std::string &text, std::string &block)
+{
+    if (text.empty() || text.size() % 4 != 0 || text.size() > 4 * ((MAX_HEADER_SIZE + 2) / 3))
+        return false;
+
+    block.assign(3 * text.size() / 4, '\0');
+    int length = EVP_DecodeBlock(reinterpret_cast<unsigned char *>(&block[0]), reinterpret_cast<const unsigned char *>(text.data()), static_cast<int>(text.size()));
+    if (length < 0)
+        return false;
+
+    // EVP_DecodeBlock counts padding as zero bytes
+    size_t padding = (text.back() == '=') + (text.size() > 1 && text[text.size() - 2] == '=');
+    block.resize(static_cast<size_t>(length) - padding);
+    return true;
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <arpa/inet.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <fcntl.h>
+#include <poll.h>
+
+/**
+ * @brief Returns the last OpenSSL error as text and clears the error queue
+ */
+inline std::string tls_error()
+{
+    unsigned long code = ERR_get_error();
+    ERR_clear_error();
+    if (code == 0)
+        return "connection closed";
+
+    char text[256];
+    ERR_error_string_n(code, text, sizeof(text));
+    return text;
+}
+
+/**
+ * @brief TLS state of one connected socket after the handshake
+ * Directions offloaded to kernel TLS can read and write the socket directly, the kernel handles the records.
+ * read() and write() go through OpenSSL and are serialized, an SSL object is not thread safe.
+ * The socket is switched to non-blocking after the handshake, so no OpenSSL call waits on the peer while holding
+ * the lock. Direct socket writes still block, asio polls a non-blocking socket it did not set up itself.
+ */
+class TlsConnection
+{
+public:
+    TlsConnection(SSL *ssl, int fd) : ssl(ssl), fd(fd)
+    {
+        offload_send = BIO_get_ktls_send(SSL_get_wbio(ssl));
+        offload_recv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    ~TlsConnection()
+    {
+        SSL_free(ssl);
+    }
+
+    TlsConnection(const TlsConnection &) = delete;
+    TlsConnection &operator=(const TlsConnection &) = delete;
+
+    bool kernel_send() const { return offload_send; }
+    bool kernel_recv() const { return offload_recv; }
+
+    /**
+     * @brief Describes the negotiated protocol, cipher and which directions the kernel took over
+     */
+    std::string description() const
+    {
+        std::string offload = offload_send && offload_recv ? "kernel TLS"
+                              : offload_send               ? "kernel TLS send"
+                              : offload_recv               ? "kernel TLS receive"
+                                                           : "user space TLS";
+        return std::string(SSL_get_version(ssl)) + " " + SSL_get_cipher_name(ssl) + ", " + offload;
+    }
+
+    /**
+     * @brief Reads decrypted bytes, blocking until some arrive
+     * A partial record returns WANT_READ, the lock is released while waiting for the rest,
+     * so writers are not held up by a slow or idle peer
+     *
+     * @param data Buffer
+     * @param size Buffer size
+     * @return long Bytes read, 0 once the peer closed the connection, -1 on error
+     */
+    long read(char *data, size_t size)
+    {
+        while (true)
+        {
+            short events;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                int length = SSL_read(ssl, data, static_cast<int>(size));
+                if (length > 0)
+                    return length;
+
+                int error = SSL_get_error(ssl, length);
+                if (error == SSL_ERROR_ZERO_RETURN)
+                    return 0;
+                // Post-handshake records carry no application data and also end in WANT_READ
+                if (error == SSL_ERROR_WANT_READ)
+                    events = POLLIN;
+                else if (error == SSL_ERROR_WANT_WRITE)
+                    events = POLLOUT;
+                else
+                    return -1;
+            }
+
+            if (!wait(events))
+                return -1;
+        }
+    }
+
+    /**
+     * @brief Writes all bytes as TLS records, blocking until the socket takes them
+     * Writers are serialized on their own, the OpenSSL lock is released while the socket is full.
+     * A retried SSL_write_ex gets the same arguments, as OpenSSL requires.
+     *
+     * @param data Bytes
+     * @param size Number of bytes
+     * @return true Everything was written
+     * @return false Connection error
+     */
+    bool write(const char *data, size_t size)
+    {
+        std::lock_guard<std::mutex> writing(write_mutex);
+        size_t written = 0;
+        while (written < size)
+        {
+            short events;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                size_t chunk = 0;
+                if (SSL_write_ex(ssl, data + written, size - written, &chunk) == 1)
+                {
+                    written += chunk;
+                    continue;
+                }
+
+                int error = SSL_get_error(ssl, 0);
+                if (error == SSL_ERROR_WANT_WRITE)
+                    events = POLLOUT;
+                else if (error == SSL_ERROR_WANT_READ)
+                    events = POLLIN;
+                else
+                    return false;
+            }
+
+            if (!wait(events))
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Sends close_notify, the socket itself is closed by its owner
+     */
+    void shutdown()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        SSL_shutdown(ssl);
+    }
+
+private:
+    /**
+     * @brief Waits without the lock until the socket is ready for what OpenSSL asked for
+     */
+    bool wait(short events)
+    {
+        pollfd ready{fd, events, 0};
+        return poll(&ready, 1, -1) >= 0 || errno == EINTR;
+    }
+
+    SSL *ssl;
+    int fd;
+    bool offload_send = false;
+    bool offload_recv = false;
+    std::mutex mutex;
+    std::mutex write_mutex;
+};
+
+/**
+ * @brief TLS settings shared by the connections of one side
+ * With kernel offload enabled OpenSSL hands the record keys to the kernel after the handshake
+ * whenever the kernel and the negotiated cipher support it, user space TLS is the fallback.
+ */
+class TlsContext
+{
+public:
+    /**
+     * @brief Server context presenting a certificate chain
+     *
+     * @param cert_file PEM certificate chain
+     * @param key_file PEM private key
+     * @param kernel_offload Whether to hand records to kernel TLS
+     */
+    TlsContext(const std::string &cert_file, const std::string &key_file, bool kernel_offload)
+        : server(true)
+    {
+        ctx = SSL_CTX_new(TLS_server_method());
+        if (!ctx)
+            throw std::runtime_error("TLS context: " + tls_error());
+        configure(kernel_offload);
+
+        if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1)
+            fail("TLS certificate " + cert_file);
+        if (SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1)
+            fail("TLS key " + key_file);
+        if (SSL_CTX_check_private_key(ctx) != 1)
+            fail("TLS key " + key_file);
+
+        // Session tickets are post-handshake records a kernel TLS receiver cannot take
+        SSL_CTX_set_num_tickets(ctx, 0);
+    }
+
+    /**
+     * @brief Client context verifying the server against a CA file, or the system store when empty
+     *
+     * @param ca_file PEM CA certificates
+     * @param kernel_offload Whether to hand records to kernel TLS
+     */
+    TlsContext(const std::string &ca_file, bool kernel_offload)
+        : server(false)
+    {
+        ctx = SSL_CTX_new(TLS_client_method());
+        if (!ctx)
+            throw std::runtime_error("TLS context: " + tls_error());
+        configure(kernel_offload);
+
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+        int loaded = ca_file.empty() ? SSL_CTX_set_default_verify_paths(ctx)
+                                     : SSL_CTX_load_verify_locations(ctx, ca_file.c_str(), nullptr);
+        if (loaded != 1)
+            fail("TLS CA " + ca_file);
+    }
+
+    ~TlsContext()
+    {
+        SSL_CTX_free(ctx);
+    }
+
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+
+    /**
+     * @brief Runs the handshake on a connected blocking socket
+     *
+     * @param fd Socket descriptor, stays owned by the caller
+     * @param host Name or address the client expects in the server certificate, unused on the server
+     * @param error Reason of a failed handshake
+     * @return std::unique_ptr<TlsConnection> Connection or nullptr
+     */
+    std::unique_ptr<TlsConnection> handshake(int fd, const std::string &host, std::string &error)
+    {
+        SSL *ssl = SSL_new(ctx);
+        if (!ssl || SSL_set_fd(ssl, fd) != 1)
+        {
+            SSL_free(ssl);
+            error = tls_error();
+            return nullptr;
+        }
+
+        if (!server)
+        {
+            in6_addr address;
+            bool numeric = inet_pton(AF_INET, host.c_str(), &address) == 1 || inet_pton(AF_INET6, host.c_str(), &address) == 1;
+            if (numeric)
+                X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str());
+            else
+            {
+                SSL_set_tlsext_host_name(ssl, host.c_str());
+                SSL_set1_host(ssl, host.c_str());
+            }
+        }
+
+        if ((server ? SSL_accept(ssl) : SSL_connect(ssl)) != 1)
+        {
+            error = tls_error();
+            SSL_free(ssl);
+            return nullptr;
+        }
+        return std::make_unique<TlsConnection>(ssl, fd);
+    }
+
+private:
+    void configure(bool kernel_offload)
+    {
+        SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+        SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
+        // Commands are newline framed, a peer closing without close_notify is a plain disconnect
+        SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+        if (kernel_offload)
+            SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+
+    [[noreturn]] void fail(const std::string &what)
+    {
+        std::string reason = tls_error();
+        SSL_CTX_free(ctx);
+        throw std::runtime_error(what + ": " + reason);
+    }
+
+    SSL_CTX *ctx = nullptr;
+    bool server;
+};
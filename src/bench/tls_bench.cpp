@@ -0,0 +1,285 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <boost/asio.hpp>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include <unistd.h>
+#include "argparse/argparse.hpp"
+#include "tls.hpp"
+
+using boost::asio::ip::tcp;
+
+/**
+ * @brief Transport of one benchmark run
+ */
+enum class BenchMode
+{
+    Plaintext,
+    UserSpaceTls,
+    KernelTls
+};
+
+/**
+ * @brief Result of one benchmark run
+ */
+struct BenchResult
+{
+    double seconds = 0;
+    std::string description;
+    bool ok = false;
+};
+
+bool write_self_signed(const std::string &cert_file, const std::string &key_file);
+BenchResult run_bench(BenchMode mode, const std::string &cert_file, const std::string &key_file, size_t total_bytes, size_t frame_size);
+
+/**
+ * @brief Loopback throughput of one server connection fanning out frames as plaintext, user space TLS and kernel TLS
+ *
+ * @param argc Argument count
+ * @param argv Arguments
+ * @return int Status
+ */
+int main(int argc, char *argv[])
+{
+    argparse::ArgumentParser program("tls-bench", "1.0.1-nightly");
+
+    program.add_argument("-m", "--megabytes")
+        .default_value(256)
+        .scan<'i', int>()
+        .help("Megabytes written per run");
+
+    program.add_argument("-f", "--frame-size")
+        .default_value(1024)
+        .scan<'i', int>()
+        .help("Bytes per frame, every frame is one write like a fan-out write of the server");
+
+    try
+    {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << "Argument parsing error: " << err.what() << "\n";
+        std::cout << program;
+        return 1;
+    }
+
+    size_t total_bytes = static_cast<size_t>(std::max(1, program.get<int>("--megabytes"))) << 20;
+    size_t frame_size = static_cast<size_t>(std::max(16, program.get<int>("--frame-size")));
+
+    char directory[] = "/tmp/tls-bench-XXXXXX";
+    if (!mkdtemp(directory))
+    {
+        std::cerr << "Cannot create a temporary directory\n";
+        return 1;
+    }
+    std::string cert_file = std::string(directory) + "/cert.pem";
+    std::string key_file = std::string(directory) + "/key.pem";
+    if (!write_self_signed(cert_file, key_file))
+    {
+        std::cerr << "Cannot create a self-signed certificate: " << tls_error() << "\n";
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::cout << "Writing " << (total_bytes >> 20) << " MB in " << frame_size << " byte frames over loopback\n";
+    const std::pair<BenchMode, const char *> modes[] = {
+        {BenchMode::Plaintext, "plaintext"},
+        {BenchMode::UserSpaceTls, "user space TLS"},
+        {BenchMode::KernelTls, "kernel TLS"}};
+
+    for (const auto &mode : modes)
+    {
+        BenchResult result = run_bench(mode.first, cert_file, key_file, total_bytes, frame_size);
+        std::cout << std::left << std::setw(16) << mode.second;
+        if (!result.ok)
+        {
+            std::cout << "failed: " << result.description << "\n";
+            continue;
+        }
+        std::cout << std::right << std::fixed << std::setprecision(1) << std::setw(10)
+                  << (total_bytes / 1048576.0) / result.seconds << " MB/s"
+                  << "  (" << result.description << ")\n";
+    }
+
+    std::remove(cert_file.c_str());
+    std::remove(key_file.c_str());
+    rmdir(directory);
+    return 0;
+}
+
+/**
+ * @brief Writes a self-signed P-256 certificate for 127.0.0.1
+ *
+ * @param cert_file Certificate output path
+ * @param key_file Private key output path
+ * @return true Both files were written
+ * @return false OpenSSL or file error
+ */
+bool write_self_signed(const std::string &cert_file, const std::string &key_file)
+{
+    EVP_PKEY *key = EVP_EC_gen("P-256");
+    X509 *cert = X509_new();
+    bool ok = key && cert;
+
+    if (ok)
+    {
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+        X509_set_pubkey(cert, key);
+
+        X509_NAME *name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("127.0.0.1"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+
+        X509V3_CTX v3;
+        X509V3_set_ctx_nodb(&v3);
+        X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+        for (const auto &extension : {std::make_pair(NID_subject_alt_name, "IP:127.0.0.1"), std::make_pair(NID_basic_constraints, "critical,CA:TRUE")})
+        {
+            X509_EXTENSION *ext = X509V3_EXT_conf_nid(nullptr, &v3, extension.first, extension.second);
+            ok = ok && ext && X509_add_ext(cert, ext, -1) == 1;
+            X509_EXTENSION_free(ext);
+        }
+        ok = ok && X509_sign(cert, key, EVP_sha256()) > 0;
+    }
+
+    FILE *cert_out = ok ? std::fopen(cert_file.c_str(), "w") : nullptr;
+    FILE *key_out = ok ? std::fopen(key_file.c_str(), "w") : nullptr;
+    ok = cert_out && key_out &&
+         PEM_write_X509(cert_out, cert) == 1 &&
+         PEM_write_PrivateKey(key_out, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+    if (cert_out)
+        std::fclose(cert_out);
+    if (key_out)
+        std::fclose(key_out);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok;
+}
+
+/**
+ * @brief Sends total_bytes from an accepted connection to a connected reader and times it
+ * The sender writes like the server: straight to the socket unless TLS records are built in user space
+ *
+ * @param mode Transport of the run
+ * @param cert_file Server certificate
+ * @param key_file Server key
+ * @param total_bytes Bytes to transfer
+ * @param frame_size Bytes per write
+ * @return BenchResult Elapsed time and the negotiated transport
+ */
+BenchResult run_bench(BenchMode mode, const std::string &cert_file, const std::string &key_file, size_t total_bytes, size_t frame_size)
+{
+    BenchResult result;
+    std::unique_ptr<TlsContext> server_context, client_context;
+    if (mode != BenchMode::Plaintext)
+    {
+        try
+        {
+            bool kernel_offload = mode == BenchMode::KernelTls;
+            server_context = std::make_unique<TlsContext>(cert_file, key_file, kernel_offload);
+            client_context = std::make_unique<TlsContext>(cert_file, kernel_offload);
+        }
+        catch (const std::runtime_error &err)
+        {
+            result.description = err.what();
+            return result;
+        }
+    }
+
+    boost::asio::io_context io_context;
+    tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    tcp::socket reader(io_context);
+    tcp::socket writer(io_context);
+
+    std::string reader_error;
+    std::unique_ptr<TlsConnection> reader_tls;
+    std::thread connector([&]()
+                          {
+        boost::system::error_code error;
+        reader.connect(acceptor.local_endpoint(), error);
+        if (error)
+            reader_error = error.message();
+        else if (client_context && !(reader_tls = client_context->handshake(reader.native_handle(), "127.0.0.1", reader_error)))
+            reader_error = "client handshake: " + reader_error; });
+
+    acceptor.accept(writer);
+    std::unique_ptr<TlsConnection> writer_tls;
+    std::string writer_error;
+    if (server_context)
+        writer_tls = server_context->handshake(writer.native_handle(), "", writer_error);
+    connector.join();
+
+    if (server_context && !writer_tls)
+    {
+        result.description = "server handshake: " + writer_error;
+        return result;
+    }
+    if (!reader_error.empty())
+    {
+        result.description = reader_error;
+        return result;
+    }
+    result.description = writer_tls ? writer_tls->description() : "no encryption";
+    if (mode == BenchMode::KernelTls && !writer_tls->kernel_send())
+        result.description += ", kernel offload unavailable";
+
+    size_t received = 0;
+    std::thread consumer([&]()
+                         {
+        std::vector<char> buffer(1 << 16);
+        while (received < total_bytes)
+        {
+            long length;
+            if (reader_tls)
+                length = reader_tls->read(buffer.data(), buffer.size());
+            else
+            {
+                boost::system::error_code error;
+                length = static_cast<long>(reader.read_some(boost::asio::buffer(buffer), error));
+                if (error)
+                    length = -1;
+            }
+            if (length <= 0)
+                break;
+            received += static_cast<size_t>(length);
+        } });
+
+    std::string frame(frame_size - 1, 'x');
+    frame += '\n';
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = true;
+    for (size_t sent = 0; ok && sent < total_bytes; sent += frame.size())
+    {
+        size_t size = std::min(frame.size(), total_bytes - sent);
+        if (writer_tls && !writer_tls->kernel_send())
+        {
+            ok = writer_tls->write(frame.data(), size);
+        }
+        else
+        {
+            boost::system::error_code error;
+            boost::asio::write(writer, boost::asio::buffer(frame.data(), size), error);
+            ok = !error;
+        }
+    }
+    consumer.join();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.ok = ok && received == total_bytes;
+    if (!result.ok)
+        result.description = "transfer stopped after " + std::to_string(received) + " bytes";
+    return result;
+}
@@ -2,12 +2,26 @@
 #include <thread>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <unordered_set>
 #include <functional>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <csignal>
 #include <boost/asio.hpp>
 #include <unistd.h> // For getpid() on Linux/macOS
 #include <sys/types.h>
 #include "argparse/argparse.hpp"
+#include "delta.hpp"
+#include "dictionary_codec.hpp"
+#include "message_header.hpp"
+#include "tls.hpp"
+
+// Dictionary versions kept per topic for frames still queued on the server during a rotation
+#define MAX_DICTIONARY_VERSIONS 4
 
 using boost::asio::ip::tcp;
 using CommandHandler = std::function<void(std::vector<std::string>)>;
@@ -15,24 +29,123 @@ using CommandHandler = std::function<void(std::vector<std::string>)>;
 // Command handler map
 std::unordered_map<std::string, CommandHandler> command_handlers;
 
+/**
+ * @brief Last payload of a delta encoded topic and its version
+ *
+ */
+struct DeltaBase
+{
+    uint64_t version = 0;
+    std::string payload;
+};
+
+/**
+ * @brief One pooled connection to the server and its traffic counters
+ *
+ */
+struct Connection
+{
+    boost::asio::io_context io_context;
+    tcp::socket socket{io_context};
+    std::unique_ptr<TlsConnection> tls;
+    std::mutex write_mutex;
+    std::atomic<uint64_t> messages_sent{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> messages_received{0};
+    std::atomic<uint64_t> bytes_received{0};
+    uint64_t consumed_since_grant = 0;
+
+    // Topic aliases announced by the server, guarded by alias_mutex
+    std::mutex alias_mutex;
+    std::unordered_map<uint32_t, std::string> alias_topics;
+    std::unordered_map<std::string, uint32_t> topic_aliases;
+    std::unordered_set<std::string> aliases_requested;
+
+    // Delta bases and compression dictionaries by topic, only used by the listener thread
+    std::unordered_map<std::string, DeltaBase> delta_bases;
+    std::unordered_map<std::string, std::map<uint32_t, std::string>> dictionaries;
+    DictionaryDecompressor decompressor;
+};
+
 // Mutexes
-std::mutex socket_mutex;
+std::mutex pool_mutex;
 
-tcp::socket *global_socket = nullptr;
+// Connection pool, topics are pinned to one connection to keep per-topic ordering
+std::vector<std::shared_ptr<Connection>> connection_pool;
+size_t pool_size = 1;
 bool connected = false;
 
+// Publishes of an open transaction all travel the control connection, guarded by pool_mutex
+bool in_transaction = false;
+
+// Credit window granted to the server per connection, 0 disables flow control
+uint64_t credit_window = 0;
+
+// Topics with subscribers as announced by the server, publishes to other topics are suppressed
+std::mutex interest_mutex;
+std::unordered_set<std::string> active_topics;
+bool track_interest = false;
+bool interest_ready = false;
+std::atomic<uint64_t> publishes_suppressed{0};
+
+// Receive compact "#<alias> <data>" frames and publish with P <alias> <data> once an alias is known
+bool use_aliases = false;
+
+// Receive delta encoded topics as keyframes and deltas
+bool use_delta = false;
+
+// Receive compressed topics deflated against their trained dictionary
+bool use_compress = false;
+
+// Receive the header block of messages published with HPUBLISH
+bool use_headers = false;
+
+// TLS towards the server, null for plaintext
+std::unique_ptr<TlsContext> tls_context;
+
 void process_command(const std::string &input);
 
-void listener_message_receive(tcp::socket &socket);
+void listener_message_receive(std::shared_ptr<Connection> connection);
 
 void setup_command_handlers();
 void handle_connect(std::vector<std::string> args);
 void handle_disconnect(std::vector<std::string>);
 void handle_publish(std::vector<std::string> args);
+void handle_mpublish(std::vector<std::string> args);
 void handle_subscribe(std::vector<std::string> args);
 void handle_unsubscribe(std::vector<std::string> args);
+void handle_stats(std::vector<std::string>);
+void handle_credit(std::vector<std::string> args);
+void handle_top(std::vector<std::string> args);
+void handle_trace(std::vector<std::string> args);
+void handle_interest(std::vector<std::string> args);
+void handle_delta(std::vector<std::string> args);
+void handle_compress(std::vector<std::string> args);
+void handle_derive(std::vector<std::string> args);
+void handle_archive(std::vector<std::string> args);
+void handle_compact(std::vector<std::string> args);
+void handle_get(std::vector<std::string> args);
+void handle_kpublish(std::vector<std::string> args);
+void handle_hpublish(std::vector<std::string> args);
+void handle_partitions(std::vector<std::string> args);
+void handle_transaction(const std::string &command, std::vector<std::string> args);
 
-void send_command(const std::string &command);
+std::shared_ptr<Connection> pick_connection(const std::string &topic);
+void process_interest(const std::string &line);
+bool is_suppressed(const std::string &topic);
+void process_alias(const std::shared_ptr<Connection> &connection, const std::string &line);
+std::string expand_alias(const std::shared_ptr<Connection> &connection, const std::string &line);
+std::string alias_for(const std::string &topic);
+std::string process_keyframe(const std::shared_ptr<Connection> &connection, const std::string &line);
+std::string process_delta(const std::shared_ptr<Connection> &connection, const std::string &line);
+size_t binary_length(const std::string &line);
+void process_dictionary(const std::shared_ptr<Connection> &connection, const std::string &line, const std::string &body);
+std::string process_compressed(const std::shared_ptr<Connection> &connection, const std::string &line, const std::string &body);
+std::string process_header_message(const std::string &line);
+void write_line(const std::shared_ptr<Connection> &connection, const std::string &line);
+size_t read_connection(const std::shared_ptr<Connection> &connection, char *data, size_t size, boost::system::error_code &error);
+void send_command(const std::string &command, const std::string &topic = "");
+void drop_connection(const std::shared_ptr<Connection> &connection);
 void cleanup_connection();
 
 /**
@@ -58,6 +171,55 @@ int main(int argc, char *argv[])
         .default_value(std::string(""))
         .help("Client name");
 
+    program.add_argument("-c", "--connections")
+        .default_value(1)
+        .scan<'i', int>()
+        .help("Number of pooled connections to the server");
+
+    program.add_argument("--credit")
+        .default_value(0)
+        .scan<'i', int>()
+        .help("Message credit window granted to the server, 0 disables flow control");
+
+    program.add_argument("--interest")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Register for interest updates and skip publishing to topics without subscribers");
+
+    program.add_argument("--aliases")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Use server assigned topic aliases for received and published messages");
+
+    program.add_argument("--delta")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Receive delta encoded topics as keyframes and deltas against the previous message");
+
+    program.add_argument("--compress")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Receive compressed topics deflated against their trained dictionary");
+
+    program.add_argument("--headers")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Receive and print the header block of messages published with HPUBLISH");
+
+    program.add_argument("--tls")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Connect with TLS");
+
+    program.add_argument("--tls-ca")
+        .default_value(std::string(""))
+        .help("PEM CA certificates the server certificate is verified against, the system store by default");
+
+    program.add_argument("--no-ktls")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Keep TLS record encryption in user space instead of handing it to kernel TLS");
+
     try
     {
         program.parse_args(argc, argv);
@@ -74,6 +236,28 @@ int main(int argc, char *argv[])
     std::string server_ip = program.get<std::string>("--server");
     std::string port = program.get<std::string>("--port");
     std::string client_name = program.get<std::string>("--name");
+    pool_size = std::max(1, program.get<int>("--connections"));
+    credit_window = std::max(0, program.get<int>("--credit"));
+    track_interest = program.get<bool>("--interest");
+    use_aliases = program.get<bool>("--aliases");
+    use_delta = program.get<bool>("--delta");
+    use_compress = program.get<bool>("--compress");
+    use_headers = program.get<bool>("--headers");
+
+    if (program.get<bool>("--tls"))
+    {
+        try
+        {
+            tls_context = std::make_unique<TlsContext>(program.get<std::string>("--tls-ca"), !program.get<bool>("--no-ktls"));
+        }
+        catch (const std::runtime_error &err)
+        {
+            std::cerr << err.what() << "\n";
+            return 1;
+        }
+        // OpenSSL writes user space records without MSG_NOSIGNAL
+        std::signal(SIGPIPE, SIG_IGN);
+    }
 
     if (!port.empty() && !client_name.empty())
     {
@@ -83,6 +267,7 @@ int main(int argc, char *argv[])
     {
         std::cout << "No connection established.\n"
                   << "Use:\n"
+                  << "\tCONNECT <serverIP> <serverPort> <clientName> [connections]\n"
                   << "\tCONNECT <serverIP> <serverPort> <clientName>\n"
                   << "\tCONNECT <serverPort> <clientName>\n";
     }
@@ -127,34 +312,50 @@ void process_command(const std::string &input)
     else
     {
         std::cout << "Invalid command! Use:\n"
+                  << "  CONNECT <serverIP> <serverPort> <clientName> [connections]\n"
                   << "  CONNECT <serverIP> <serverPort> <clientName>\n"
                   << "  CONNECT <serverPort> <clientName>\n"
                   << "  DISCONNECT\n"
                   << "  PUBLISH <topic> <data>\n"
-                  << "  SUBSCRIBE <topic>\n"
-                  << "  UNSUBSCRIBE <topic>\n";
+                  << "  MPUBLISH <topic1,topic2,...> <data>\n"
+                  << "  SUBSCRIBE <topic> [RATE <ms>] [SAMPLE <n>] [FROM <time>]\n"
+                  << "  UNSUBSCRIBE <topic>\n"
+                  << "  CREDIT <messages> [bytes]\n"
+                  << "  TOP <topics|clients> [messages|bytes|fanout] [count] [seconds]\n"
+                  << "  TRACE [SAMPLE <n>]\n"
+                  << "  INTEREST [OFF]\n"
+                  << "  DELTA <topic> <keyframe interval>|OFF\n"
+                  << "  COMPRESS <topic> <retrain interval>|OFF\n"
+                  << "  DERIVE <topic> count|min|max|mean|last <source> <window ms>|OFF\n"
+                  << "  ARCHIVE <topic> ON|OFF\n"
+                  << "  COMPACT <topic> ON|OFF\n"
+                  << "  GET <topic> <key> [<key>...]\n"
+                  << "  HPUBLISH <topic> <data> [TTL <ms>] [TRACE <id>] [<name>=<value>...]\n"
+                  << "  STATS\n";
     }
 }
 
 /**
  * @brief Function to receive messages
+ * Runs once per pooled connection and prints every newline-delimited frame
  *
- * @param socket TCP Socket
+ * @param connection Pooled connection to read from
  */
-void listener_message_receive(tcp::socket &socket)
+void listener_message_receive(std::shared_ptr<Connection> connection)
 {
     try
     {
         char data[1024];
+        std::string pending;
         while (true)
         {
             boost::system::error_code error;
-            size_t length = socket.read_some(boost::asio::buffer(data), error);
+            size_t length = read_connection(connection, data, sizeof(data), error);
 
             if (error == boost::asio::error::eof)
             {
                 std::cout << "[DISCONNECT] Server closed the connection.\n";
-                cleanup_connection();
+                drop_connection(connection);
                 break;
             }
             else if (error)
@@ -162,13 +363,69 @@ void listener_message_receive(tcp::socket &socket)
                 throw boost::system::system_error(error);
             }
 
-            std::string received_msg(data, length);
-            std::cout << received_msg << std::endl;
+            connection->bytes_received += length;
+            pending.append(data, length);
+
+            size_t newline;
+            while ((newline = pending.find('\n')) != std::string::npos)
+            {
+                // Dictionary and compressed frames carry a binary body after their header line
+                size_t body_size = binary_length(pending.substr(0, newline));
+                if (pending.size() < newline + 1 + body_size)
+                    break;
+
+                connection->messages_received++;
+                std::string line = pending.substr(0, newline);
+                std::string body = pending.substr(newline + 1, body_size);
+                pending.erase(0, newline + 1 + body_size);
+
+                // Compact, key, delta and compressed frames are printed in the regular message format
+                bool is_message = true;
+                bool uses_credit = false;
+                if (line.rfind("[DICT] ", 0) == 0)
+                {
+                    // Dictionaries are queued behind messages and use credit like them
+                    process_dictionary(connection, line, body);
+                    is_message = false;
+                    uses_credit = true;
+                }
+                else if (line.rfind("[Z] ", 0) == 0)
+                    line = process_compressed(connection, line, body);
+                else if (!line.empty() && line[0] == '#')
+                    line = expand_alias(connection, line);
+                else if (line.rfind("[KEY] ", 0) == 0)
+                    line = process_keyframe(connection, line);
+                else if (line.rfind("[DELTA] ", 0) == 0)
+                    line = process_delta(connection, line);
+                else if (line.rfind("[HMessage] ", 0) == 0)
+                    line = process_header_message(line);
+                else
+                {
+                    is_message = line.rfind("[Message]", 0) == 0;
+                    // Partition assignments are queued behind messages and use credit like them
+                    uses_credit = line.rfind("[ASSIGN] ", 0) == 0;
+                }
+
+                if (line.rfind("[ALIAS] ", 0) == 0 || line.rfind("[SERVER_ERROR] No alias for topic: ", 0) == 0)
+                    process_alias(connection, line);
+                std::cout << line << std::endl;
+
+                if (line.rfind("[INTEREST] ", 0) == 0 || line == "[SERVER] Interest updates enabled")
+                    process_interest(line);
+
+                // Replenish the credit window once half of it is consumed
+                if (credit_window > 0 && (is_message || uses_credit) &&
+                    ++connection->consumed_since_grant >= std::max<uint64_t>(1, credit_window / 2))
+                {
+                    write_line(connection, "CREDIT " + std::to_string(connection->consumed_since_grant));
+                    connection->consumed_since_grant = 0;
+                }
+            }
         }
     }
     catch (std::exception &e)
     {
-        cleanup_connection();
+        drop_connection(connection);
     }
 }
 
@@ -181,20 +438,43 @@ void setup_command_handlers()
     command_handlers["CONNECT"] = handle_connect;
     command_handlers["DISCONNECT"] = handle_disconnect;
     command_handlers["PUBLISH"] = handle_publish;
+    command_handlers["MPUBLISH"] = handle_mpublish;
     command_handlers["SUBSCRIBE"] = handle_subscribe;
     command_handlers["UNSUBSCRIBE"] = handle_unsubscribe;
+    command_handlers["STATS"] = handle_stats;
+    command_handlers["CREDIT"] = handle_credit;
+    command_handlers["TOP"] = handle_top;
+    command_handlers["TRACE"] = handle_trace;
+    command_handlers["INTEREST"] = handle_interest;
+    command_handlers["DELTA"] = handle_delta;
+    command_handlers["COMPRESS"] = handle_compress;
+    command_handlers["DERIVE"] = handle_derive;
+    command_handlers["ARCHIVE"] = handle_archive;
+    command_handlers["COMPACT"] = handle_compact;
+    command_handlers["GET"] = handle_get;
+    command_handlers["KPUBLISH"] = handle_kpublish;
+    command_handlers["HPUBLISH"] = handle_hpublish;
+    command_handlers["PARTITIONS"] = handle_partitions;
+    command_handlers["BEGIN"] = [](std::vector<std::string> args)
+    { handle_transaction("BEGIN", args); };
+    command_handlers["COMMIT"] = [](std::vector<std::string> args)
+    { handle_transaction("COMMIT", args); };
+    command_handlers["ABORT"] = [](std::vector<std::string> args)
+    { handle_transaction("ABORT", args); };
 }
 
 /**
  * @brief Connect command Handler
+ * Opens the connection pool, every pooled connection registers with the same client name
  *
- * @param args Command arguments, IP, PORT, NAME
+ * @param args Command arguments, IP, PORT, NAME and optional pool size
  */
 void handle_connect(std::vector<std::string> args)
 {
-    if (args.size() < 2 || args.size() > 3)
+    if (args.size() < 2 || args.size() > 4)
     {
         std::cout << "Invalid CONNECT command. Use:\n"
+                  << "  CONNECT <serverIP> <serverPort> <clientName> [connections]\n"
                   << "  CONNECT <serverIP> <serverPort> <clientName>\n"
                   << "  CONNECT <serverPort> <clientName>\n";
         return;
@@ -202,13 +482,26 @@ void handle_connect(std::vector<std::string> args)
 
     if (connected)
     {
-        std::cout << "[WARNING] Already conneedted";
+        std::cout << "[WARNING] Already connected\n";
         return;
     }
 
-    std::string server_ip = (args.size() == 3) ? args[0] : "127.0.0.1";
-    std::string port = (args.size() == 3) ? args[1] : args[0];
-    std::string client_name = (args.size() == 3) ? args[2] : args[1];
+    std::string server_ip = (args.size() >= 3) ? args[0] : "127.0.0.1";
+    std::string port = (args.size() >= 3) ? args[1] : args[0];
+    std::string client_name = (args.size() >= 3) ? args[2] : args[1];
+    size_t connections = pool_size;
+    if (args.size() == 4)
+    {
+        try
+        {
+            connections = std::max(1, std::stoi(args[3]));
+        }
+        catch (std::exception &)
+        {
+            std::cout << "Invalid connection count: " << args[3] << "\n";
+            return;
+        }
+    }
 
     // Get the process ID (PID)
     pid_t pid = getpid();
@@ -217,31 +510,64 @@ void handle_connect(std::vector<std::string> args)
 
     try
     {
-        boost::asio::io_context *io_context = new boost::asio::io_context();
-        tcp::socket *socket = new tcp::socket(*io_context);
-        tcp::resolver resolver(*io_context);
+        std::vector<std::shared_ptr<Connection>> pool;
+        for (size_t i = 0; i < connections; ++i)
+        {
+            auto connection = std::make_shared<Connection>();
+            tcp::resolver resolver(connection->io_context);
 
-        auto endpoints = resolver.resolve(server_ip, port);
-        boost::asio::connect(*socket, endpoints);
+            auto endpoints = resolver.resolve(server_ip, port);
+            boost::asio::connect(connection->socket, endpoints);
+            if (tls_context)
+            {
+                std::string error;
+                connection->tls = tls_context->handshake(connection->socket.native_handle(), server_ip, error);
+                if (!connection->tls)
+                    throw std::runtime_error("TLS handshake failed: " + error);
+            }
+            pool.push_back(connection);
+        }
 
         {
-            std::lock_guard<std::mutex> lock(socket_mutex);
-            global_socket = socket;
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            connection_pool = pool;
             connected = true;
         }
 
-        // Send CONNECT command with PID
-        send_command("CONNECT " + port + " " + client_name + " " + std::to_string(pid));
+        // Send CONNECT command with PID on every pooled connection
+        for (auto &connection : pool)
+        {
+            write_line(connection, "CONNECT " + port + " " + client_name + " " + std::to_string(pid));
+            if (credit_window > 0)
+                write_line(connection, "CREDIT " + std::to_string(credit_window));
+            if (use_aliases)
+                write_line(connection, "ENABLE aliases");
+            if (use_delta)
+                write_line(connection, "ENABLE delta");
+            if (use_compress)
+                write_line(connection, "ENABLE compress");
+            if (use_headers)
+                write_line(connection, "ENABLE headers");
+        }
+
+        // Interest updates are global, the control connection is enough
+        if (track_interest)
+            write_line(pool.front(), "INTEREST");
 
         // Log successful connection
-        std::cout << "[CONNECT] (success) [" << client_name << " (" << pid << ") " << server_ip << " " << port << "]\n";
+        std::cout << "[CONNECT] (success) [" << client_name << " (" << pid << ") " << server_ip << " " << port
+                  << "] connections: " << pool.size() << "\n";
 
-        // Start receiving thread
-        std::thread receiver(listener_message_receive, std::ref(*socket));
-        receiver.detach();
+        // Start one receiving thread per connection
+        for (auto &connection : pool)
+        {
+            std::thread receiver(listener_message_receive, connection);
+            receiver.detach();
+        }
     }
     catch (std::exception &e)
     {
+        cleanup_connection();
         std::cerr << "[CONNECT] (failed) [" << client_name << " (" << pid << ") " << server_ip << " " << port << "] (" << e.what() << ")\n";
     }
 }
@@ -252,7 +578,21 @@ void handle_connect(std::vector<std::string> args)
  */
 void handle_disconnect(std::vector<std::string>)
 {
-    send_command("DISCONNECT");
+    std::vector<std::shared_ptr<Connection>> pool;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        pool = connection_pool;
+    }
+    for (auto &connection : pool)
+    {
+        try
+        {
+            write_line(connection, "DISCONNECT");
+        }
+        catch (std::exception &)
+        {
+        }
+    }
     cleanup_connection();
     std::cout << "[DISCONNECT] Client manually disconnected.\n";
 }
@@ -270,31 +610,224 @@ void handle_publish(std::vector<std::string> args)
         return;
     }
 
+    if (is_suppressed(args[0]))
+    {
+        publishes_suppressed++;
+        std::cout << "[SUPPRESSED] No subscribers for topic: " << args[0] << "\n";
+        return;
+    }
+
+    std::ostringstream oss;
+    std::string alias = alias_for(args[0]);
+    if (alias.empty())
+        oss << "PUBLISH " << args[0] << " ";
+    else
+        oss << "P " << alias << " ";
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        oss << args[i] << " ";
+    }
+
+    send_command(oss.str(), args[0]);
+}
+
+/**
+ * @brief Multi-topic publish command Handler
+ * Sends the payload once for all topics, topics without subscribers are dropped from the list.
+ * The command travels the connection of the first remaining topic, so it is only ordered
+ * with single-topic publishes of that topic.
+ *
+ * @param args Comma separated topics and Data to be sent to the server
+ */
+void handle_mpublish(std::vector<std::string> args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Invalid MPUBLISH command. Use:\n  MPUBLISH <topic1,topic2,...> <data>\n";
+        return;
+    }
+
+    std::vector<std::string> topics;
+    std::istringstream list(args[0]);
+    std::string topic;
+    while (std::getline(list, topic, ','))
+    {
+        if (topic.empty())
+            continue;
+        if (is_suppressed(topic))
+        {
+            publishes_suppressed++;
+            continue;
+        }
+        topics.push_back(topic);
+    }
+
+    if (topics.empty())
+    {
+        std::cout << "[SUPPRESSED] No subscribers for topics: " << args[0] << "\n";
+        return;
+    }
+
     std::ostringstream oss;
-    oss << "PUBLISH " << args[0] << " ";
+    oss << "MPUBLISH " << topics[0];
+    for (size_t i = 1; i < topics.size(); ++i)
+    {
+        oss << "," << topics[i];
+    }
+    oss << " ";
     for (size_t i = 1; i < args.size(); ++i)
     {
         oss << args[i] << " ";
     }
 
-    send_command(oss.str());
+    send_command(oss.str(), topics[0]);
+}
+
+/**
+ * @brief Keyed publish command Handler
+ * Messages of one key land in one partition, the topic connection keeps them in order
+ *
+ * @param args Topic, key and Data to be sent to the server
+ */
+void handle_kpublish(std::vector<std::string> args)
+{
+    if (args.size() < 3)
+    {
+        std::cout << "Invalid KPUBLISH command. Use:\n  KPUBLISH <topic> <key> <data>\n";
+        return;
+    }
+
+    if (is_suppressed(args[0]))
+    {
+        publishes_suppressed++;
+        std::cout << "[SUPPRESSED] No subscribers for topic: " << args[0] << "\n";
+        return;
+    }
+
+    std::ostringstream oss;
+    oss << "KPUBLISH";
+    for (const auto &arg : args)
+    {
+        oss << " " << arg;
+    }
+    send_command(oss.str(), args[0]);
+}
+
+/**
+ * @brief Header publish command Handler
+ * Packs the options into a binary header block the server reads without touching the payload.
+ * A key=<value> field partitions the message like KPUBLISH.
+ *
+ * @param args Topic, Data and header options: TTL <ms>, TRACE <id> and <name>=<value> fields
+ */
+void handle_hpublish(std::vector<std::string> args)
+{
+    const char *usage = "Invalid HPUBLISH command. Use:\n  HPUBLISH <topic> <data> [TTL <ms>] [TRACE <id>] [<name>=<value>...]\n";
+    if (args.size() < 2)
+    {
+        std::cout << usage;
+        return;
+    }
+
+    uint32_t ttl_ms = 0;
+    uint64_t trace_id = 0;
+    std::vector<std::pair<std::string, std::string>> fields;
+    for (size_t i = 2; i < args.size(); ++i)
+    {
+        size_t equals = args[i].find('=');
+        bool valid = true;
+        if ((args[i] == "TTL" || args[i] == "TRACE") && i + 1 < args.size())
+        {
+            std::istringstream value(args[i + 1]);
+            valid = args[i] == "TTL" ? static_cast<bool>(value >> ttl_ms) : static_cast<bool>(value >> trace_id);
+            ++i;
+        }
+        else if (equals != std::string::npos && equals > 0)
+            fields.emplace_back(args[i].substr(0, equals), args[i].substr(equals + 1));
+        else
+            valid = false;
+
+        if (!valid)
+        {
+            std::cout << usage;
+            return;
+        }
+    }
+
+    std::string block = encode_header(ttl_ms, trace_id, fields);
+    if (block.empty())
+    {
+        std::cout << "Header too large, at most " << MAX_HEADER_SIZE << " bytes are allowed.\n";
+        return;
+    }
+
+    if (is_suppressed(args[0]))
+    {
+        publishes_suppressed++;
+        std::cout << "[SUPPRESSED] No subscribers for topic: " << args[0] << "\n";
+        return;
+    }
+
+    send_command("HPUBLISH " + args[0] + " " + header_to_base64(block) + " " + args[1], args[0]);
+}
+
+/**
+ * @brief Partitions command Handler
+ * Sets the number of key partitions of a topic on the server
+ *
+ * @param args Topic and number of partitions
+ */
+void handle_partitions(std::vector<std::string> args)
+{
+    if (args.size() != 2)
+    {
+        std::cout << "Invalid PARTITIONS command. Use:\n  PARTITIONS <topic> <count>\n";
+        return;
+    }
+
+    send_command("PARTITIONS " + args[0] + " " + args[1], args[0]);
+}
+
+/**
+ * @brief Transaction command Handler for BEGIN, COMMIT and ABORT
+ * The server buffers per connection, so publishes between BEGIN and COMMIT use the control connection
+ *
+ * @param command BEGIN, COMMIT or ABORT
+ * @param args No arguments are expected
+ */
+void handle_transaction(const std::string &command, std::vector<std::string> args)
+{
+    if (!args.empty())
+    {
+        std::cout << "Invalid " << command << " command. Use:\n  " << command << "\n";
+        return;
+    }
+
+    send_command(command);
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    in_transaction = connected && command == "BEGIN";
 }
 
 /**
  * @brief Subscribe command Handler
  *
- * @param args Topics to subscribe to
+ * @param args Topic to subscribe to and optional RATE <ms> / SAMPLE <n> / FROM <time> options
  */
 void handle_subscribe(std::vector<std::string> args)
 {
-    if (args.size() != 1)
+    if (args.empty() || args.size() % 2 == 0)
     {
-        std::cout << "Usage: SUBSCRIBE <topic>\n";
+        std::cout << "Usage: SUBSCRIBE <topic> [RATE <ms>] [SAMPLE <n>] [FROM <time>] | SUBSCRIBE <topic> GROUP <name>\n";
         return;
     }
 
-    std::string command = "SUBSCRIBE " + args[0];
-    send_command(command);
+    std::string command = "SUBSCRIBE";
+    for (const auto &arg : args)
+    {
+        command += " " + arg;
+    }
+    send_command(command, args[0]);
 }
 
 /**
@@ -311,18 +844,538 @@ void handle_unsubscribe(std::vector<std::string> args)
     }
 
     std::string command = "UNSUBSCRIBE " + args[0];
+    send_command(command, args[0]);
+}
+
+/**
+ * @brief Delta command Handler
+ * Turns delta encoding of a topic on the server on or off
+ *
+ * @param args Topic and keyframe interval or OFF
+ */
+void handle_delta(std::vector<std::string> args)
+{
+    if (args.size() != 2)
+    {
+        std::cout << "Invalid DELTA command. Use:\n  DELTA <topic> <keyframe interval>|OFF\n";
+        return;
+    }
+
+    send_command("DELTA " + args[0] + " " + args[1], args[0]);
+}
+
+/**
+ * @brief Compress command Handler
+ * Turns dictionary compression of a topic on the server on or off
+ *
+ * @param args Topic and retrain interval or OFF
+ */
+void handle_compress(std::vector<std::string> args)
+{
+    if (args.size() != 2)
+    {
+        std::cout << "Invalid COMPRESS command. Use:\n  COMPRESS <topic> <retrain interval>|OFF\n";
+        return;
+    }
+
+    send_command("COMPRESS " + args[0] + " " + args[1], args[0]);
+}
+
+/**
+ * @brief Derive command Handler
+ * Defines a topic the server publishes with an aggregate of a source topic once per window
+ *
+ * @param args Derived topic, operator, source topic and window in ms, or the derived topic and OFF
+ */
+void handle_derive(std::vector<std::string> args)
+{
+    if (args.size() != 4 && !(args.size() == 2 && args[1] == "OFF"))
+    {
+        std::cout << "Invalid DERIVE command. Use:\n  DERIVE <topic> count|min|max|mean|last <source> <window ms>|OFF\n";
+        return;
+    }
+
+    std::ostringstream oss;
+    oss << "DERIVE";
+    for (const auto &arg : args)
+    {
+        oss << " " << arg;
+    }
+    send_command(oss.str(), args[0]);
+}
+
+/**
+ * @brief Archive command Handler
+ * Turns server side archiving of a topic on or off
+ *
+ * @param args Topic and ON or OFF
+ */
+void handle_archive(std::vector<std::string> args)
+{
+    if (args.size() != 2 || (args[1] != "ON" && args[1] != "OFF"))
+    {
+        std::cout << "Invalid ARCHIVE command. Use:\n  ARCHIVE <topic> ON|OFF\n";
+        return;
+    }
+
+    send_command("ARCHIVE " + args[0] + " " + args[1], args[0]);
+}
+
+/**
+ * @brief Compact command Handler
+ * Turns the server side table of the latest value per key of a topic on or off
+ *
+ * @param args Topic and ON or OFF
+ */
+void handle_compact(std::vector<std::string> args)
+{
+    if (args.size() != 2 || (args[1] != "ON" && args[1] != "OFF"))
+    {
+        std::cout << "Invalid COMPACT command. Use:\n  COMPACT <topic> ON|OFF\n";
+        return;
+    }
+
+    send_command("COMPACT " + args[0] + " " + args[1], args[0]);
+}
+
+/**
+ * @brief Get command Handler
+ * Looks up the latest values of keys of a compacted topic
+ *
+ * @param args Topic and keys
+ */
+void handle_get(std::vector<std::string> args)
+{
+    if (args.size() < 2)
+    {
+        std::cout << "Invalid GET command. Use:\n  GET <topic> <key> [<key>...]\n";
+        return;
+    }
+
+    std::string command = "GET";
+    for (const auto &arg : args)
+        command += " " + arg;
+    send_command(command, args[0]);
+}
+
+/**
+ * @brief Credit command Handler
+ * Grants additional credit to the server on every pooled connection
+ *
+ * @param args Number of messages and optional number of bytes
+ */
+void handle_credit(std::vector<std::string> args)
+{
+    if (args.empty() || args.size() > 2)
+    {
+        std::cout << "Invalid CREDIT command. Use:\n  CREDIT <messages> [bytes]\n";
+        return;
+    }
+
+    std::vector<std::shared_ptr<Connection>> pool;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        pool = connection_pool;
+    }
+    if (pool.empty())
+    {
+        std::cout << "ERROR: Not connected to any server.\n";
+        return;
+    }
+
+    std::string command = "CREDIT " + args[0] + (args.size() == 2 ? " " + args[1] : "");
+    for (auto &connection : pool)
+    {
+        try
+        {
+            write_line(connection, command);
+        }
+        catch (std::exception &)
+        {
+            std::cerr << "[ERROR] Failed to send command. Connection lost.\n";
+            drop_connection(connection);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Top command Handler
+ * Asks the server for the heaviest topics or clients
+ *
+ * @param args topics|clients [messages|bytes|fanout] [count] [seconds]
+ */
+void handle_top(std::vector<std::string> args)
+{
+    if (args.empty() || args.size() > 4)
+    {
+        std::cout << "Invalid TOP command. Use:\n  TOP <topics|clients> [messages|bytes|fanout] [count] [seconds]\n";
+        return;
+    }
+
+    std::string command = "TOP";
+    for (const auto &arg : args)
+    {
+        command += " " + arg;
+    }
     send_command(command);
 }
 
+/**
+ * @brief Trace command Handler
+ * Exports the server trace buffer or changes its sampling rate
+ *
+ * @param args Empty or SAMPLE <n>
+ */
+void handle_trace(std::vector<std::string> args)
+{
+    if (!args.empty() && (args.size() != 2 || args[0] != "SAMPLE"))
+    {
+        std::cout << "Invalid TRACE command. Use:\n  TRACE [SAMPLE <n>]\n";
+        return;
+    }
+
+    send_command(args.empty() ? "TRACE" : "TRACE SAMPLE " + args[1]);
+}
+
+/**
+ * @brief Interest command Handler
+ * Turns interest tracking on or off for the current connection
+ *
+ * @param args Empty or OFF
+ */
+void handle_interest(std::vector<std::string> args)
+{
+    if (args.size() > 1 || (args.size() == 1 && args[0] != "OFF"))
+    {
+        std::cout << "Invalid INTEREST command. Use:\n  INTEREST [OFF]\n";
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(interest_mutex);
+        track_interest = args.empty();
+        interest_ready = false;
+        active_topics.clear();
+    }
+    send_command(args.empty() ? "INTEREST" : "INTEREST OFF");
+}
+
+/**
+ * @brief Stats command Handler
+ * Prints per-connection and aggregate traffic counters of the pool
+ *
+ */
+void handle_stats(std::vector<std::string>)
+{
+    std::vector<std::shared_ptr<Connection>> pool;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        pool = connection_pool;
+    }
+
+    uint64_t messages_sent = 0, bytes_sent = 0, messages_received = 0, bytes_received = 0;
+    for (size_t i = 0; i < pool.size(); ++i)
+    {
+        const auto &connection = pool[i];
+        std::cout << "[STATS] connection " << i
+                  << " sent: " << connection->messages_sent << " msgs / " << connection->bytes_sent << " bytes,"
+                  << " received: " << connection->messages_received << " msgs / " << connection->bytes_received << " bytes\n";
+        messages_sent += connection->messages_sent;
+        bytes_sent += connection->bytes_sent;
+        messages_received += connection->messages_received;
+        bytes_received += connection->bytes_received;
+    }
+    std::cout << "[STATS] total (" << pool.size() << " connections)"
+              << " sent: " << messages_sent << " msgs / " << bytes_sent << " bytes,"
+              << " received: " << messages_received << " msgs / " << bytes_received << " bytes,"
+              << " suppressed: " << publishes_suppressed << " publishes\n";
+}
+
+/**
+ * @brief Selects the pooled connection for a topic
+ * A topic always maps to the same connection so its messages stay ordered
+ *
+ * @param topic Topic name, empty selects the control connection
+ * @return std::shared_ptr<Connection> Connection or nullptr if not connected
+ */
+std::shared_ptr<Connection> pick_connection(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (!connected || connection_pool.empty())
+        return nullptr;
+    if (topic.empty() || in_transaction)
+        return connection_pool.front();
+    return connection_pool[std::hash<std::string>{}(topic) % connection_pool.size()];
+}
+
+/**
+ * @brief Applies an interest update pushed by the server
+ *
+ * @param line [INTEREST] <topic> <0|1> or the end of the initial snapshot
+ */
+void process_interest(const std::string &line)
+{
+    std::lock_guard<std::mutex> lock(interest_mutex);
+    if (!track_interest)
+        return;
+
+    if (line == "[SERVER] Interest updates enabled")
+    {
+        interest_ready = true;
+        return;
+    }
+
+    std::istringstream iss(line.substr(11));
+    std::string topic;
+    int active = 0;
+    if (!(iss >> topic >> active))
+        return;
+
+    if (active)
+        active_topics.insert(topic);
+    else
+        active_topics.erase(topic);
+}
+
+/**
+ * @brief Checks whether a publish can be skipped because the topic has no subscribers
+ * Nothing is suppressed until the initial snapshot of active topics has arrived
+ *
+ * @param topic Topic name
+ */
+bool is_suppressed(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(interest_mutex);
+    return track_interest && interest_ready && active_topics.count(topic) == 0;
+}
+
+/**
+ * @brief Records a topic alias announced by the server
+ * A refused request is forgotten, so the alias is asked for again with a later publish
+ *
+ * @param connection Connection the announcement arrived on
+ * @param line [ALIAS] <alias> <topic> or the error refusing an ALIAS request
+ */
+void process_alias(const std::shared_ptr<Connection> &connection, const std::string &line)
+{
+    const std::string refused = "[SERVER_ERROR] No alias for topic: ";
+    if (line.rfind(refused, 0) == 0)
+    {
+        std::string topic = line.substr(refused.size(), line.find(',') - refused.size());
+        std::lock_guard<std::mutex> lock(connection->alias_mutex);
+        connection->aliases_requested.erase(topic);
+        return;
+    }
+
+    std::istringstream iss(line.substr(8));
+    uint32_t alias = 0;
+    std::string topic;
+    if (!(iss >> alias >> topic))
+        return;
+
+    std::lock_guard<std::mutex> lock(connection->alias_mutex);
+    connection->alias_topics[alias] = topic;
+    connection->topic_aliases[topic] = alias;
+}
+
+/**
+ * @brief Expands a compact frame to the regular message format
+ *
+ * @param connection Connection the frame arrived on
+ * @param line #<alias> <data>
+ * @return std::string [Message] line, or the frame itself if the alias is unknown
+ */
+std::string expand_alias(const std::shared_ptr<Connection> &connection, const std::string &line)
+{
+    size_t space = line.find(' ');
+    if (space == std::string::npos)
+        return line;
+
+    uint32_t alias = 0;
+    if (!(std::istringstream(line.substr(1, space - 1)) >> alias))
+        return line;
+
+    std::lock_guard<std::mutex> lock(connection->alias_mutex);
+    auto it = connection->alias_topics.find(alias);
+    if (it == connection->alias_topics.end())
+        return line;
+    return "[Message] Topic: " + it->second + " Data: " + line.substr(space + 1);
+}
+
+/**
+ * @brief Stores the keyframe of a delta encoded topic as the base of following deltas
+ *
+ * @param connection Connection the frame arrived on
+ * @param line [KEY] <topic> <version> <data>
+ * @return std::string [Message] line
+ */
+std::string process_keyframe(const std::shared_ptr<Connection> &connection, const std::string &line)
+{
+    // The payload is the rest of the line, it may contain spaces
+    std::istringstream iss(line.substr(6));
+    std::string topic;
+    DeltaBase base;
+    if (!(iss >> topic >> base.version) || iss.get() != ' ' || !std::getline(iss, base.payload))
+        return line;
+
+    std::string message = "[Message] Topic: " + topic + " Data: " + base.payload;
+    connection->delta_bases[topic] = std::move(base);
+    return message;
+}
+
+/**
+ * @brief Applies a delta to the stored base of its topic
+ * A delta that does not match the stored version asks the server for a keyframe
+ *
+ * @param connection Connection the frame arrived on
+ * @param line [DELTA] <topic> <version> <base version> <operations>
+ * @return std::string [Message] line or a warning if the base is missing
+ */
+std::string process_delta(const std::shared_ptr<Connection> &connection, const std::string &line)
+{
+    // Operations are the rest of the line, inserted text may contain spaces
+    std::istringstream iss(line.substr(8));
+    std::string topic, ops;
+    uint64_t version = 0, base_version = 0;
+    if (!(iss >> topic >> version >> base_version) || iss.get() != ' ' || !std::getline(iss, ops))
+        return line;
+
+    auto it = connection->delta_bases.find(topic);
+    std::string payload;
+    if (it == connection->delta_bases.end() || it->second.version != base_version || !delta_apply(it->second.payload, ops, payload))
+    {
+        connection->delta_bases.erase(topic);
+        try
+        {
+            write_line(connection, "RESYNC " + topic);
+        }
+        catch (std::exception &)
+        {
+        }
+        return "[WARNING] Missing delta base of " + topic + ", keyframe requested";
+    }
+
+    it->second.version = version;
+    it->second.payload = payload;
+    return "[Message] Topic: " + topic + " Data: " + payload;
+}
+
+/**
+ * @brief Returns the length of the binary body following a frame header
+ *
+ * @param line Header line, [DICT] <topic> <version> <length> or [Z] <topic> <version> <length>
+ * @return size_t Body length, 0 for text frames
+ */
+size_t binary_length(const std::string &line)
+{
+    if (line.rfind("[DICT] ", 0) != 0 && line.rfind("[Z] ", 0) != 0)
+        return 0;
+
+    size_t space = line.rfind(' ');
+    try
+    {
+        return std::stoul(line.substr(space + 1));
+    }
+    catch (std::exception &)
+    {
+        return 0;
+    }
+}
+
+/**
+ * @brief Stores a dictionary version of a compressed topic, the oldest versions are dropped
+ *
+ * @param connection Connection the frame arrived on
+ * @param line [DICT] <topic> <version> <length>
+ * @param body Dictionary
+ */
+void process_dictionary(const std::shared_ptr<Connection> &connection, const std::string &line, const std::string &body)
+{
+    std::istringstream iss(line.substr(7));
+    std::string topic;
+    uint32_t version = 0;
+    if (!(iss >> topic >> version))
+        return;
+
+    auto &versions = connection->dictionaries[topic];
+    versions[version] = body;
+    while (versions.size() > MAX_DICTIONARY_VERSIONS)
+        versions.erase(versions.begin());
+}
+
+/**
+ * @brief Decompresses a message with the dictionary version it names
+ *
+ * @param connection Connection the frame arrived on
+ * @param line [Z] <topic> <version> <length>
+ * @param body Compressed message
+ * @return std::string [Message] line or a warning if the dictionary is unknown
+ */
+std::string process_compressed(const std::shared_ptr<Connection> &connection, const std::string &line, const std::string &body)
+{
+    std::istringstream iss(line.substr(4));
+    std::string topic;
+    uint32_t version = 0;
+    if (!(iss >> topic >> version))
+        return line;
+
+    auto it = connection->dictionaries.find(topic);
+    std::string payload;
+    if (it == connection->dictionaries.end() || !it->second.count(version) ||
+        !connection->decompressor.decompress(it->second[version], body, payload))
+    {
+        return "[WARNING] Missing dictionary " + std::to_string(version) + " of " + topic;
+    }
+    return "[Message] Topic: " + topic + " Data: " + payload;
+}
+
+/**
+ * @brief Returns the alias of a topic for publishing
+ * An unknown topic is requested once with ALIAS <topic>, until the answer arrives it is published by name
+ *
+ * @param topic Topic name
+ * @return std::string Alias or empty if not known yet
+ */
+std::string alias_for(const std::string &topic)
+{
+    if (!use_aliases)
+        return "";
+
+    auto connection = pick_connection(topic);
+    if (!connection)
+        return "";
+
+    {
+        std::lock_guard<std::mutex> lock(connection->alias_mutex);
+        auto it = connection->topic_aliases.find(topic);
+        if (it != connection->topic_aliases.end())
+            return std::to_string(it->second);
+        if (!connection->aliases_requested.insert(topic).second)
+            return "";
+    }
+
+    try
+    {
+        write_line(connection, "ALIAS " + topic);
+    }
+    catch (std::exception &)
+    {
+        // The publish that follows reports the broken connection
+    }
+    return "";
+}
+
 /**
  * @brief Sends a command to the server
  *
  * @param command Any command defined by the handlers
+ * @param topic Topic the command refers to, selects the pooled connection
  */
-void send_command(const std::string &command)
+void send_command(const std::string &command, const std::string &topic)
 {
-    std::lock_guard<std::mutex> lock(socket_mutex);
-    if (!connected || global_socket == nullptr)
+    auto connection = pick_connection(topic);
+    if (!connection)
     {
         std::cout << "ERROR: Not connected to any server.\n";
         return;
@@ -332,34 +1385,130 @@ void send_command(const std::string &command)
 
     try
     {
-        std::string formatted_command = command + "\n";
-        boost::asio::write(*global_socket, boost::asio::buffer(formatted_command));
+        write_line(connection, command);
     }
     catch (std::exception &)
     {
         std::cerr << "[ERROR] Failed to send command. Connection lost.\n";
-        cleanup_connection();
+        drop_connection(connection);
+    }
+}
+
+/**
+ * @brief Writes one command line on a pooled connection
+ *
+ * @param connection Pooled connection
+ * @param line Command without the trailing newline
+ */
+void write_line(const std::shared_ptr<Connection> &connection, const std::string &line)
+{
+    std::string formatted_command = line + "\n";
+    std::lock_guard<std::mutex> lock(connection->write_mutex);
+    if (connection->tls && !connection->tls->kernel_send())
+    {
+        if (!connection->tls->write(formatted_command.data(), formatted_command.size()))
+            throw boost::system::system_error(boost::asio::error::broken_pipe);
+    }
+    else
+    {
+        boost::asio::write(connection->socket, boost::asio::buffer(formatted_command));
     }
+    connection->messages_sent++;
+    connection->bytes_sent += formatted_command.size();
 }
 
 /**
- * @brief Utility function to clean up the socket safely
+ * @brief Reads bytes from a pooled connection, only called by its listener thread
+ *
+ * @param connection Pooled connection
+ * @param data Buffer
+ * @param size Buffer size
+ * @param error Read error, eof once the server closed the connection
+ * @return size_t Bytes read
+ */
+size_t read_connection(const std::shared_ptr<Connection> &connection, char *data, size_t size, boost::system::error_code &error)
+{
+    if (!connection->tls)
+        return connection->socket.read_some(boost::asio::buffer(data, size), error);
+
+    long length = connection->tls->read(data, size);
+    if (length == 0)
+        error = boost::asio::error::eof;
+    else if (length < 0)
+        error = boost::asio::error::connection_reset;
+    return length > 0 ? static_cast<size_t>(length) : 0;
+}
+
+/**
+ * @brief Tears down the pool if the given connection still belongs to it
+ * A stale listener of a previous pool must not close a newer one
+ *
+ * @param connection Connection that failed
+ */
+void drop_connection(const std::shared_ptr<Connection> &connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (std::find(connection_pool.begin(), connection_pool.end(), connection) == connection_pool.end())
+            return;
+    }
+    cleanup_connection();
+}
+
+/**
+ * @brief Prints a header frame as a regular message followed by its decoded header fields
+ *
+ * @param line [HMessage] Topic: <topic> Header: <header> Data: <data>
+ * @return std::string [Message] line with the header, or the frame itself if the header is invalid
+ */
+std::string process_header_message(const std::string &line)
+{
+    std::istringstream iss(line);
+    std::string tag, topic_label, topic, header_label, header, data_label, payload;
+    std::string block;
+    MessageHeaderView view;
+    if (!(iss >> tag >> topic_label >> topic >> header_label >> header >> data_label >> payload) ||
+        !header_from_base64(header, block) || !view.parse(block))
+        return line;
+
+    std::ostringstream oss;
+    oss << "[Message] Topic: " << topic << " Data: " << payload << " Header:";
+    if (view.ttl_ms())
+        oss << " ttl=" << view.ttl_ms();
+    if (view.trace_id())
+        oss << " trace=" << view.trace_id();
+    for (const auto &field : view.fields())
+        oss << " " << field.first << "=" << field.second;
+    return oss.str();
+}
+
+/**
+ * @brief Utility function to clean up the pooled sockets safely
+ * Sockets are only closed here, listeners keep their connection alive until they exit
  *
  */
 void cleanup_connection()
 {
-    std::lock_guard<std::mutex> lock(socket_mutex);
-    if (global_socket)
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (auto &connection : connection_pool)
     {
         try
         {
-            global_socket->close();
+            boost::system::error_code ignored;
+            if (connection->tls)
+                connection->tls->shutdown();
+            connection->socket.shutdown(tcp::socket::shutdown_both, ignored);
+            connection->socket.close();
         }
         catch (...)
         {
         }
-        delete global_socket;
-        global_socket = nullptr;
     }
+    connection_pool.clear();
     connected = false;
+    in_transaction = false;
+
+    std::lock_guard<std::mutex> interest_lock(interest_mutex);
+    interest_ready = false;
+    active_topics.clear();
 }
@@ -0,0 +1,183 @@
+#include "acl.hpp"
+
+#include <fstream>
+#include <sstream>
+
+/**
+ * @brief Loads the rules of an ACL file, blank lines and lines starting with '#' are skipped
+ *
+ * @param path ACL file
+ * @param error Reason the file was rejected
+ * @return true Every line was a valid rule
+ * @return false File missing or malformed
+ */
+bool AclRules::load(const std::string &path, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+
+    std::vector<AclRule> loaded;
+    std::string line;
+    size_t number = 0;
+    while (std::getline(file, line))
+    {
+        number++;
+        std::istringstream iss(line);
+        std::string action, client, permission, topic, extra;
+        if (!(iss >> action) || action[0] == '#')
+            continue;
+
+        AclRule rule;
+        bool valid = (iss >> client >> permission >> topic) && !(iss >> extra);
+        rule.allow = action == "allow";
+        valid = valid && (rule.allow || action == "deny");
+        if (permission == "publish")
+            rule.permissions = AclPublish;
+        else if (permission == "subscribe")
+            rule.permissions = AclSubscribe;
+        else if (permission == "all")
+            rule.permissions = AclPublish | AclSubscribe;
+        if (!valid || rule.permissions == 0)
+        {
+            error = path + ":" + std::to_string(number) + ": expected allow|deny <client> publish|subscribe|all <topic>";
+            return false;
+        }
+
+        rule.client = client;
+        rule.topic = topic;
+        loaded.push_back(std::move(rule));
+    }
+
+    rules = std::move(loaded);
+    return true;
+}
+
+/**
+ * @brief Selects the rules whose client pattern matches a client name, keeping their order
+ *
+ * @param client Client name, empty for sessions that did not CONNECT
+ * @return std::vector<AclRule> Rules of the client
+ */
+std::vector<AclRule> AclRules::rules_for(const std::string &client) const
+{
+    std::vector<AclRule> selected;
+    for (const auto &rule : rules)
+    {
+        if (acl_match(rule.client, client))
+            selected.push_back(rule);
+    }
+    return selected;
+}
+
+/**
+ * @brief Replaces the rules of the session and forgets every resolved topic
+ *
+ * @param client_rules Rules selected for the client
+ */
+void SessionAcl::reset(std::vector<AclRule> client_rules)
+{
+    rules = std::move(client_rules);
+    resolved.clear();
+    publish.clear();
+    subscribe.clear();
+}
+
+/**
+ * @brief Checks a permission on a topic
+ *
+ * @param topic_id Interned id of the topic
+ * @param topic Topic name, only read the first time the topic is checked
+ * @param permission Permission to test
+ * @return true Permission granted
+ */
+bool SessionAcl::allowed(uint32_t topic_id, const std::string &topic, AclPermission permission)
+{
+    size_t word = topic_id / 64;
+    uint64_t bit = uint64_t(1) << (topic_id % 64);
+    if (word >= resolved.size() || !(resolved[word] & bit))
+        resolve(word, bit, topic);
+
+    return ((permission == AclPublish ? publish : subscribe)[word] & bit) != 0;
+}
+
+/**
+ * @brief Evaluates the rules for one topic, per permission the first matching rule decides
+ * A permission no rule mentions is denied
+ *
+ * @param word Word of the topic in the bitsets
+ * @param bit Bit of the topic in its word
+ * @param topic Topic name
+ */
+void SessionAcl::resolve(size_t word, uint64_t bit, const std::string &topic)
+{
+    if (word >= resolved.size())
+    {
+        resolved.resize(word + 1, 0);
+        publish.resize(word + 1, 0);
+        subscribe.resize(word + 1, 0);
+    }
+
+    uint8_t decided = 0;
+    uint8_t granted = 0;
+    for (const auto &rule : rules)
+    {
+        uint8_t open = rule.permissions & ~decided;
+        if (open == 0 || !acl_match(rule.topic, topic))
+            continue;
+
+        decided |= open;
+        if (rule.allow)
+            granted |= open;
+        if (decided == (AclPublish | AclSubscribe))
+            break;
+    }
+
+    resolved[word] |= bit;
+    if (granted & AclPublish)
+        publish[word] |= bit;
+    if (granted & AclSubscribe)
+        subscribe[word] |= bit;
+}
+
+/**
+ * @brief Glob match with '*' for any run of characters and '?' for a single character
+ *
+ * @param pattern Pattern
+ * @param text Text
+ * @return true Pattern matches the whole text
+ */
+bool acl_match(const std::string &pattern, const std::string &text)
+{
+    size_t p = 0, t = 0;
+    size_t star = std::string::npos, resume = 0;
+    while (t < text.size())
+    {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+        {
+            p++;
+            t++;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            star = p++;
+            resume = t;
+        }
+        else if (star != std::string::npos)
+        {
+            p = star + 1;
+            t = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    while (p < pattern.size() && pattern[p] == '*')
+        p++;
+    return p == pattern.size();
+}
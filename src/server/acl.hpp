@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Permissions an ACL rule grants or denies
+ */
+enum AclPermission : uint8_t
+{
+    AclPublish = 1u << 0,
+    AclSubscribe = 1u << 1,
+};
+
+/**
+ * @brief One line of the ACL file: allow|deny <client pattern> publish|subscribe|all <topic pattern>
+ * Patterns match with '*' for any run of characters and '?' for a single character.
+ */
+struct AclRule
+{
+    bool allow = false;
+    std::string client;
+    uint8_t permissions = 0;
+    std::string topic;
+};
+
+/**
+ * @brief Rules of the ACL file in file order
+ */
+class AclRules
+{
+public:
+    bool load(const std::string &path, std::string &error);
+    std::vector<AclRule> rules_for(const std::string &client) const;
+
+private:
+    std::vector<AclRule> rules;
+};
+
+/**
+ * @brief Permissions of one session as bitsets indexed by topic id
+ * The rules of the client are selected once on CONNECT. A topic is resolved against them the first
+ * time it is checked, every later check is a bit test. Not thread safe, the session thread owns it.
+ */
+class SessionAcl
+{
+public:
+    void reset(std::vector<AclRule> client_rules);
+    bool allowed(uint32_t topic_id, const std::string &topic, AclPermission permission);
+
+private:
+    void resolve(size_t word, uint64_t bit, const std::string &topic);
+
+    std::vector<AclRule> rules;
+    std::vector<uint64_t> resolved;
+    std::vector<uint64_t> publish;
+    std::vector<uint64_t> subscribe;
+};
+
+bool acl_match(const std::string &pattern, const std::string &text);
@@ -0,0 +1,1195 @@
+#include "archive.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static void put_le(std::string &out, uint64_t value, int width)
+{
+    for (int i = 0; i < width; ++i)
+        out += static_cast<char>(value >> (8 * i));
+}
+
+static uint64_t get_le(const char *data, int width)
+{
+    uint64_t value = 0;
+    for (int i = width - 1; i >= 0; --i)
+        value = (value << 8) | static_cast<uint8_t>(data[i]);
+    return value;
+}
+
+static uint32_t record_crc(const char *data, size_t length)
+{
+    return static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef *>(data + 8), static_cast<uInt>(length - 8)));
+}
+
+/**
+ * @brief Reads the record at the start of a buffer
+ *
+ * @param data Segment bytes from a record boundary
+ * @param size Bytes available
+ * @param record Parsed record, pointing into data
+ * @return size_t Record size, 0 at the end of the records or for a torn or corrupt record
+ */
+size_t parse_archive_record(const char *data, size_t size, ArchiveRecordView &record)
+{
+    if (size < ARCHIVE_RECORD_HEADER)
+        return 0;
+
+    size_t length = get_le(data, 4);
+    if (length < ARCHIVE_RECORD_HEADER || length > size || record_crc(data, length) != get_le(data + 4, 4))
+        return 0;
+
+    size_t key_size = get_le(data + 24, 2);
+    if (ARCHIVE_RECORD_HEADER + key_size > length)
+        return 0;
+
+    record.offset = get_le(data + 8, 8);
+    record.timestamp_ms = get_le(data + 16, 8);
+    record.key = data + ARCHIVE_RECORD_HEADER;
+    record.key_size = key_size;
+    record.payload = record.key + key_size;
+    record.payload_size = length - ARCHIVE_RECORD_HEADER - key_size;
+    return length;
+}
+
+/**
+ * @brief Encodes a record, see ArchiveRecordView for the layout
+ *
+ * @param record Record with its offset in the topic
+ * @return std::string Record bytes
+ */
+std::string encode_archive_record(const ArchiveRecord &record)
+{
+    size_t length = ARCHIVE_RECORD_HEADER + record.key.size() + record.payload.size();
+    std::string data;
+    data.reserve(length);
+    put_le(data, length, 4);
+    put_le(data, 0, 4);
+    put_le(data, record.offset, 8);
+    put_le(data, record.timestamp_ms, 8);
+    put_le(data, record.key.size(), 2);
+    data += record.key;
+    data += record.payload;
+
+    uint32_t crc = record_crc(data.data(), length);
+    for (int i = 0; i < 4; ++i)
+        data[4 + i] = static_cast<char>(crc >> (8 * i));
+    return data;
+}
+
+static std::string segment_file_name(uint64_t base_offset, const char *extension)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020llu%s", static_cast<unsigned long long>(base_offset), extension);
+    return name;
+}
+
+/**
+ * @brief File name of a segment, zero padded so names sort like offsets
+ */
+std::string archive_segment_name(uint64_t base_offset)
+{
+    return segment_file_name(base_offset, ".log");
+}
+
+/**
+ * @brief File name of the sparse index of a segment, it stays in the hot directory
+ */
+std::string archive_index_name(uint64_t base_offset)
+{
+    return segment_file_name(base_offset, ".idx");
+}
+
+/**
+ * @brief File name of a segment compressed into the cold directory
+ */
+std::string archive_cold_name(uint64_t base_offset)
+{
+    return segment_file_name(base_offset, ".logz");
+}
+
+/**
+ * @brief Lists the first offsets of the segments in a topic directory
+ *
+ * @param directory Topic directory
+ * @param extension .log for hot segments, .logz for cold ones
+ * @return std::vector<uint64_t> Sorted first offsets, empty if the directory does not exist
+ */
+std::vector<uint64_t> list_archive_segments(const std::string &directory, const std::string &extension)
+{
+    std::vector<uint64_t> segments;
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+        return segments;
+
+    while (dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name.size() != 20 + extension.size() || name.compare(20, std::string::npos, extension) != 0 ||
+            name.find_first_not_of("0123456789") != 20)
+            continue;
+        segments.push_back(std::strtoull(name.c_str(), nullptr, 10));
+    }
+    closedir(dir);
+
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+/**
+ * @brief Reads the entries of a sparse index
+ *
+ * @param path Index file
+ * @param max_entries Entries to read from the start
+ * @return std::vector<ArchiveIndexEntry> Entries, empty if the file is missing
+ */
+std::vector<ArchiveIndexEntry> load_archive_index(const std::string &path, size_t max_entries)
+{
+    std::vector<ArchiveIndexEntry> entries;
+    std::ifstream file(path, std::ios::binary);
+    char data[ARCHIVE_INDEX_ENTRY];
+    while (entries.size() < max_entries && file.read(data, sizeof(data)))
+        entries.push_back({get_le(data, 8), get_le(data + 8, 8), get_le(data + 16, 8)});
+    return entries;
+}
+
+/**
+ * @brief Finds the segment and the position a replay starts reading at
+ * By time: the max timestamps of the first index entries never decrease across segments, so the
+ * last segment whose first entry saw only older records is found by binary search, then the last
+ * entry in it that saw only older records. A missing index reads the segment from its start.
+ *
+ * @param directory Topic directory
+ * @param segments First offsets of the segments
+ * @param cursor Replay position
+ * @param position Byte position in the returned segment
+ * @return size_t Index into segments
+ */
+static size_t seek_archive(const std::string &directory, const std::vector<uint64_t> &segments,
+                           const ArchiveCursor &cursor, uint64_t &position)
+{
+    auto index_path = [&](size_t segment)
+    { return directory + "/" + archive_index_name(segments[segment]); };
+    auto before = [&](const ArchiveIndexEntry &entry)
+    { return cursor.by_offset ? entry.offset <= cursor.offset : entry.max_timestamp_ms < cursor.timestamp_ms; };
+
+    size_t segment = 0;
+    if (cursor.by_offset)
+    {
+        auto next = std::upper_bound(segments.begin(), segments.end(), cursor.offset);
+        segment = next == segments.begin() ? 0 : static_cast<size_t>(next - segments.begin()) - 1;
+    }
+    else
+    {
+        size_t low = 0, high = segments.size();
+        while (high - low > 1)
+        {
+            size_t middle = (low + high) / 2;
+            std::vector<ArchiveIndexEntry> first = load_archive_index(index_path(middle), 1);
+            if (first.empty() || before(first[0]))
+                low = middle;
+            else
+                high = middle;
+        }
+        segment = low;
+    }
+
+    position = 0;
+    for (const auto &entry : load_archive_index(index_path(segment)))
+    {
+        if (!before(entry))
+            break;
+        position = entry.position;
+    }
+    return segment;
+}
+
+/**
+ * @brief Compresses a closed segment block by block, so a replay only inflates the blocks it reads
+ * Layout: the zlib streams of the blocks, the table of their positions (8) and sizes (4), then the
+ * footer with the table position (8), block count (4), block size (4), segment size (8) and magic (4).
+ * The target is written under a temporary name, synced and renamed.
+ *
+ * @param source Segment file
+ * @param target Compressed file
+ * @param error Reason of a failed compression
+ * @return true Target is complete on disk
+ */
+bool compress_archive_segment(const std::string &source, const std::string &target, std::string &error)
+{
+    std::ifstream in(source, std::ios::binary);
+    std::string temporary = target + ".tmp";
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    if (!in || !out)
+    {
+        error = "cannot open " + (in ? temporary : source) + ": " + std::strerror(errno);
+        return false;
+    }
+
+    std::string block(ARCHIVE_COLD_BLOCK_SIZE, '\0');
+    std::string packed(compressBound(ARCHIVE_COLD_BLOCK_SIZE), '\0');
+    std::string table;
+    uint64_t position = 0, size = 0;
+    uint32_t blocks = 0;
+    while (in.read(&block[0], static_cast<std::streamsize>(block.size())) || in.gcount() > 0)
+    {
+        uLongf length = static_cast<uLongf>(packed.size());
+        if (compress2(reinterpret_cast<Bytef *>(&packed[0]), &length, reinterpret_cast<const Bytef *>(block.data()), static_cast<uLong>(in.gcount()), Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+            error = "cannot compress " + source;
+            return false;
+        }
+        out.write(packed.data(), static_cast<std::streamsize>(length));
+        put_le(table, position, 8);
+        put_le(table, length, 4);
+        position += length;
+        size += static_cast<uint64_t>(in.gcount());
+        blocks++;
+    }
+
+    put_le(table, position, 8);
+    put_le(table, blocks, 4);
+    put_le(table, ARCHIVE_COLD_BLOCK_SIZE, 4);
+    put_le(table, size, 8);
+    put_le(table, ARCHIVE_COLD_MAGIC, 4);
+    out.write(table.data(), static_cast<std::streamsize>(table.size()));
+    out.close();
+
+    int fd = ::open(temporary.c_str(), O_RDONLY);
+    bool synced = fd >= 0 && fdatasync(fd) == 0;
+    if (fd >= 0)
+        ::close(fd);
+    if (!out || !synced || std::rename(temporary.c_str(), target.c_str()) != 0)
+    {
+        error = "cannot write " + target + ": " + std::strerror(errno);
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns a cached block and marks it as recently used
+ *
+ * @param key Cold segment path and block number
+ * @return std::shared_ptr<const std::string> Decompressed block, null when not cached
+ */
+std::shared_ptr<const std::string> ArchiveBlockCache::get(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = lookup.find(key);
+    if (found == lookup.end())
+        return nullptr;
+    entries.splice(entries.begin(), entries, found->second);
+    return found->second->second;
+}
+
+/**
+ * @brief Caches a block, evicting the least recently used one when full
+ *
+ * @param key Cold segment path and block number
+ * @param block Decompressed block
+ */
+void ArchiveBlockCache::put(const std::string &key, std::shared_ptr<const std::string> block)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (lookup.count(key))
+        return;
+    entries.emplace_front(key, std::move(block));
+    lookup[key] = entries.begin();
+    if (entries.size() > capacity)
+    {
+        lookup.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+/**
+ * @brief Segment opened for a replay, the hot file or, once tiered, its compressed copy
+ * The hot file is preferred, it exists until its compressed copy is complete.
+ */
+class SegmentSource
+{
+public:
+    explicit SegmentSource(ArchiveBlockCache &cache) : cache(cache) {}
+    ~SegmentSource()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    SegmentSource(const SegmentSource &) = delete;
+    SegmentSource &operator=(const SegmentSource &) = delete;
+
+    /**
+     * @brief Opens a segment
+     *
+     * @param hot_path Segment file
+     * @param cold_path Compressed copy, empty without a cold tier
+     * @return true Segment can be read
+     */
+    bool open(const std::string &hot_path, const std::string &cold_path)
+    {
+        fd = ::open(hot_path.c_str(), O_RDONLY);
+        if (fd >= 0 || cold_path.empty())
+            return fd >= 0;
+
+        fd = ::open(cold_path.c_str(), O_RDONLY);
+        path = cold_path;
+        struct stat status;
+        char footer[ARCHIVE_COLD_FOOTER];
+        if (fd < 0 || fstat(fd, &status) != 0 || status.st_size < ARCHIVE_COLD_FOOTER ||
+            !read_exact(footer, sizeof(footer), static_cast<uint64_t>(status.st_size) - ARCHIVE_COLD_FOOTER) ||
+            get_le(footer + 24, 4) != ARCHIVE_COLD_MAGIC)
+            return false;
+
+        // A damaged footer must not size allocations, the table has to fill the file up to the footer
+        // and cover the raw size in blocks laid out back to back
+        uint64_t table_position = get_le(footer, 8);
+        uint64_t count = get_le(footer + 8, 4);
+        block_size = get_le(footer + 12, 4);
+        size = get_le(footer + 16, 8);
+        uint64_t file_size = static_cast<uint64_t>(status.st_size);
+        if (block_size != ARCHIVE_COLD_BLOCK_SIZE || table_position > file_size - ARCHIVE_COLD_FOOTER ||
+            table_position + count * 12 + ARCHIVE_COLD_FOOTER != file_size || count != (size + block_size - 1) / block_size)
+            return false;
+
+        std::string table(static_cast<size_t>(count) * 12, '\0');
+        if (count > 0 && !read_exact(&table[0], table.size(), table_position))
+            return false;
+        uint64_t position = 0;
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            uint64_t start = get_le(&table[i * 12], 8);
+            uint32_t length = static_cast<uint32_t>(get_le(&table[i * 12 + 8], 4));
+            if (start != position || length > compressBound(static_cast<uLong>(block_size)))
+                return false;
+            blocks.emplace_back(start, length);
+            position += length;
+        }
+        if (position != table_position)
+            return false;
+        cold = true;
+        return true;
+    }
+
+    /**
+     * @brief Reads segment bytes, short only at the end of the segment
+     *
+     * @param data Destination
+     * @param length Bytes wanted
+     * @param position Position in the segment
+     * @return ssize_t Bytes read, 0 at the end, -1 on errors
+     */
+    ssize_t read(char *data, size_t length, uint64_t position)
+    {
+        if (!cold)
+        {
+            ssize_t result;
+            do
+                result = pread(fd, data, length, static_cast<off_t>(position));
+            while (result < 0 && errno == EINTR);
+            return result;
+        }
+
+        size_t copied = 0;
+        while (copied < length && position < size)
+        {
+            std::shared_ptr<const std::string> block = load(position / block_size);
+            if (!block)
+                return copied ? static_cast<ssize_t>(copied) : -1;
+            size_t inside = position % block_size;
+            if (inside >= block->size())
+                break;
+            size_t count = std::min(length - copied, block->size() - inside);
+            std::memcpy(data + copied, block->data() + inside, count);
+            copied += count;
+            position += count;
+        }
+        return static_cast<ssize_t>(copied);
+    }
+
+private:
+    bool read_exact(char *data, size_t length, uint64_t position)
+    {
+        size_t done = 0;
+        while (done < length)
+        {
+            ssize_t result = pread(fd, data + done, length - done, static_cast<off_t>(position + done));
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result <= 0)
+                return false;
+            done += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    std::shared_ptr<const std::string> load(uint64_t number)
+    {
+        if (number >= blocks.size())
+            return nullptr;
+        std::string key = path + "#" + std::to_string(number);
+        if (auto block = cache.get(key))
+            return block;
+
+        std::string packed(blocks[number].second, '\0');
+        auto block = std::make_shared<std::string>(std::min<uint64_t>(block_size, size - number * block_size), '\0');
+        uLongf length = static_cast<uLongf>(block->size());
+        if (!read_exact(&packed[0], packed.size(), blocks[number].first) ||
+            uncompress(reinterpret_cast<Bytef *>(&(*block)[0]), &length, reinterpret_cast<const Bytef *>(packed.data()), static_cast<uLong>(packed.size())) != Z_OK)
+            return nullptr;
+        block->resize(length);
+        cache.put(key, block);
+        return block;
+    }
+
+    ArchiveBlockCache &cache;
+    int fd = -1;
+    bool cold = false;
+    std::string path;
+    uint64_t block_size = 0;
+    uint64_t size = 0;
+    // Position and compressed size of every block
+    std::vector<std::pair<uint64_t, uint32_t>> blocks;
+};
+
+/**
+ * @brief Finds the offset after the last record of a topic on disk
+ *
+ * @param directory Topic directory
+ * @return uint64_t Next offset, 0 for a topic never archived
+ */
+static uint64_t recover_next_offset(const std::string &directory)
+{
+    std::vector<uint64_t> segments = list_archive_segments(directory);
+    if (segments.empty())
+        return 0;
+
+    std::ifstream file(directory + "/" + archive_segment_name(segments.back()), std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint64_t next = segments.back();
+    size_t end = 0;
+    ArchiveRecordView record;
+    while (size_t length = parse_archive_record(data.data() + end, data.size() - end, record))
+    {
+        end += length;
+        next = record.offset + 1;
+    }
+    return next;
+}
+
+/**
+ * @brief Construct a new Archive Segment Writer
+ *
+ * @param directory Topic directory
+ * @param segment_bytes Size after which a segment is closed and the next one started
+ */
+ArchiveSegmentWriter::ArchiveSegmentWriter(const std::string &directory, size_t segment_bytes)
+    : directory(directory), segment_bytes(segment_bytes), buffer(nullptr, std::free)
+{
+    void *memory = nullptr;
+    if (posix_memalign(&memory, ARCHIVE_BLOCK_SIZE, ARCHIVE_BUFFER_SIZE) == 0)
+        buffer.reset(static_cast<char *>(memory));
+}
+
+ArchiveSegmentWriter::~ArchiveSegmentWriter()
+{
+    close();
+}
+
+/**
+ * @brief Opens the newest segment of the topic for appending, or the first one
+ * A torn record at the end, left by a crash, is cut off and the index of the segment rebuilt
+ *
+ * @param error Reason the topic cannot be archived
+ * @return true Ready to append
+ */
+bool ArchiveSegmentWriter::open(std::string &error)
+{
+    if (!buffer)
+    {
+        error = "cannot allocate the write buffer";
+        return false;
+    }
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        error = "cannot create " + directory + ": " + std::strerror(errno);
+        return false;
+    }
+
+    std::vector<uint64_t> segments = list_archive_segments(directory);
+    if (segments.empty())
+        return open_segment(0, 0, error);
+
+    uint64_t base = segments.back();
+    std::ifstream file(directory + "/" + archive_segment_name(base), std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    // The first entry carries the max timestamp of the older segments
+    std::vector<ArchiveIndexEntry> first = load_archive_index(directory + "/" + archive_index_name(base), 1);
+    max_timestamp = first.empty() ? 0 : first[0].max_timestamp_ms;
+
+    size_t end = 0;
+    end_offset = base;
+    ArchiveRecordView record;
+    while (size_t length = parse_archive_record(data.data() + end, data.size() - end, record))
+    {
+        index_record(end, record.offset, record.timestamp_ms);
+        end += length;
+        end_offset = record.offset + 1;
+    }
+
+    if (!open_segment(base, end, error))
+        return false;
+    std::memcpy(buffer.get(), data.data() + buffer_start, buffer_used);
+    return true;
+}
+
+/**
+ * @brief Appends a record, starting a new segment when the current one is full
+ * A writer whose segment could not be opened takes no records, it has to be reopened.
+ *
+ * @param record Record with its offset in the topic
+ * @param error Reason of a failed write
+ * @return true Record is buffered
+ */
+bool ArchiveSegmentWriter::append(const ArchiveRecord &record, std::string &error)
+{
+    if (fd < 0)
+    {
+        error = "no open segment";
+        return false;
+    }
+
+    std::string data = encode_archive_record(record);
+    if (data.size() > ARCHIVE_BUFFER_SIZE - ARCHIVE_BLOCK_SIZE)
+    {
+        error = "record of " + std::to_string(data.size()) + " bytes exceeds the write buffer";
+        return false;
+    }
+
+    size_t size = buffer_start + buffer_used;
+    if (size > 0 && size + data.size() > segment_bytes && (!close_segment(error) || !open_segment(record.offset, 0, error)))
+        return false;
+
+    if (buffer_used + data.size() > ARCHIVE_BUFFER_SIZE && !flush(error))
+        return false;
+
+    index_record(buffer_start + buffer_used, record.offset, record.timestamp_ms);
+    std::memcpy(buffer.get() + buffer_used, data.data(), data.size());
+    buffer_used += data.size();
+    dirty = true;
+    end_offset = record.offset + 1;
+    return true;
+}
+
+/**
+ * @brief Adds an index entry for a record at the start of the segment or far enough from the last entry
+ *
+ * @param position Byte position of the record in the segment
+ * @param offset Offset of the record
+ * @param timestamp_ms Timestamp of the record
+ */
+void ArchiveSegmentWriter::index_record(size_t position, uint64_t offset, uint64_t timestamp_ms)
+{
+    if (position == 0 || position - last_indexed >= ARCHIVE_INDEX_INTERVAL)
+    {
+        put_le(index_pending, max_timestamp, 8);
+        put_le(index_pending, offset, 8);
+        put_le(index_pending, position, 8);
+        last_indexed = position;
+    }
+    max_timestamp = std::max(max_timestamp, timestamp_ms);
+}
+
+/**
+ * @brief Writes the buffered records as whole blocks, the partial last block stays buffered
+ * New index entries follow the records, so an entry never points past the written records.
+ *
+ * @param error Reason of a failed write
+ * @return true Buffered records and their index entries are on disk
+ */
+bool ArchiveSegmentWriter::flush(std::string &error)
+{
+    if (fd < 0)
+    {
+        error = "no open segment";
+        return false;
+    }
+    if (!dirty && index_pending.empty())
+        return true;
+    if (!dirty)
+        return write_index(error);
+
+    // Zero padding reads as the end marker until the next flush overwrites it
+    size_t length = (buffer_used + ARCHIVE_BLOCK_SIZE - 1) / ARCHIVE_BLOCK_SIZE * ARCHIVE_BLOCK_SIZE;
+    std::memset(buffer.get() + buffer_used, 0, length - buffer_used);
+    if (!write_buffer(length, error))
+        return false;
+
+    size_t full = buffer_used / ARCHIVE_BLOCK_SIZE * ARCHIVE_BLOCK_SIZE;
+    std::memmove(buffer.get(), buffer.get() + full, buffer_used - full);
+    buffer_start += full;
+    buffer_used -= full;
+    dirty = false;
+    return write_index(error);
+}
+
+/**
+ * @brief Appends the pending index entries to the index file
+ *
+ * @param error Reason of a failed write
+ * @return true Entries are written
+ */
+bool ArchiveSegmentWriter::write_index(std::string &error)
+{
+    size_t written = 0;
+    while (written < index_pending.size())
+    {
+        ssize_t result = ::write(index_fd, index_pending.data() + written, index_pending.size() - written);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+        {
+            error = "write to index " + archive_index_name(segment_base) + " failed: " + std::strerror(errno);
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    index_pending.clear();
+    return true;
+}
+
+/**
+ * @brief Closes the current segment, errors are dropped
+ */
+void ArchiveSegmentWriter::close()
+{
+    std::string ignored;
+    close_segment(ignored);
+}
+
+/**
+ * @brief Opens a segment for writing, with direct I/O unless the file system refuses it
+ *
+ * @param base_offset First offset of the segment
+ * @param size Bytes of records already in the segment
+ * @param error Reason of a failed open
+ * @return true Segment is open
+ */
+bool ArchiveSegmentWriter::open_segment(uint64_t base_offset, size_t size, std::string &error)
+{
+    std::string path = directory + "/" + archive_segment_name(base_offset);
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_DIRECT, 0644);
+    direct = fd >= 0;
+    if (fd < 0 && errno == EINVAL)
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        error = "cannot open " + path + ": " + std::strerror(errno);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    // The index is rewritten from the entries of the records kept in the segment
+    std::string index_path = directory + "/" + archive_index_name(base_offset);
+    index_fd = ::open(index_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (index_fd < 0)
+    {
+        error = "cannot open " + index_path + ": " + std::strerror(errno);
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    segment_base = base_offset;
+    buffer_start = size / ARCHIVE_BLOCK_SIZE * ARCHIVE_BLOCK_SIZE;
+    buffer_used = size - buffer_start;
+    dirty = false;
+    return true;
+}
+
+/**
+ * @brief Writes the rest of the segment, trims the padding of the last block and syncs it
+ *
+ * @param error Reason of a failed write
+ * @return true Segment is complete on disk
+ */
+bool ArchiveSegmentWriter::close_segment(std::string &error)
+{
+    if (fd < 0)
+        return true;
+
+    bool ok = flush(error);
+    if (ok && (ftruncate(fd, static_cast<off_t>(buffer_start + buffer_used)) != 0 || fdatasync(fd) != 0))
+    {
+        error = std::string("cannot complete segment: ") + std::strerror(errno);
+        ok = false;
+    }
+
+    ::close(fd);
+    ::close(index_fd);
+    fd = index_fd = -1;
+    buffer_start = buffer_used = 0;
+    dirty = false;
+    index_pending.clear();
+    return ok;
+}
+
+/**
+ * @brief Writes the head of the buffer at its file position
+ *
+ * @param length Bytes to write, a multiple of the block size
+ * @param error Reason of a failed write
+ * @return true Everything was written
+ */
+bool ArchiveSegmentWriter::write_buffer(size_t length, std::string &error)
+{
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t result = pwrite(fd, buffer.get() + written, length - written, static_cast<off_t>(buffer_start + written));
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0 && errno == EINVAL && direct)
+        {
+            // Some file systems accept O_DIRECT on open but not for writes, fall back to buffered writes
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+            continue;
+        }
+        if (result <= 0)
+        {
+            error = "write to segment " + archive_segment_name(segment_base) + " failed: " + std::strerror(errno);
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+/**
+ * @brief Construct a new Archive
+ *
+ * @param directory Archive root, every topic gets a directory below it
+ * @param segment_bytes Size after which a segment is closed and the next one started
+ */
+Archive::Archive(const std::string &directory, size_t segment_bytes)
+    : directory(directory), segment_bytes(segment_bytes)
+{
+}
+
+Archive::~Archive()
+{
+    stop();
+}
+
+/**
+ * @brief Enables the cold tier, called before start
+ *
+ * @param cold Directory compressed segments are moved to
+ * @param age Time since the last write after which a closed segment is moved
+ */
+void Archive::set_cold_tier(const std::string &cold, std::chrono::seconds age)
+{
+    cold_directory = cold;
+    cold_age = age;
+}
+
+/**
+ * @brief Creates the archive directories and starts the writer thread, and the tiering thread with a cold tier
+ *
+ * @param error Reason the archive cannot be used
+ * @return true Archive is running
+ */
+bool Archive::start(std::string &error)
+{
+    for (const std::string &path : {directory, cold_directory})
+    {
+        if (!path.empty() && ((mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) || access(path.c_str(), W_OK) != 0))
+        {
+            error = "cannot write to archive directory " + path + ": " + std::strerror(errno);
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running)
+        return true;
+    running = true;
+    worker = std::thread(&Archive::run, this);
+    if (!cold_directory.empty())
+        tier_worker = std::thread(&Archive::tier, this);
+    return true;
+}
+
+/**
+ * @brief Writes the queued records, closes every segment and stops the threads
+ */
+void Archive::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    wakeup.notify_all();
+    tier_wakeup.notify_all();
+    if (worker.joinable())
+        worker.join();
+    if (tier_worker.joinable())
+        tier_worker.join();
+}
+
+/**
+ * @brief Recovers the next offset of a topic from its segments, once, before it is archived or replayed
+ * Reads the disk, so it is called outside the routing lock
+ *
+ * @param topic Topic name
+ */
+void Archive::open_topic(const std::string &topic)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (next_offsets.count(topic))
+            return;
+    }
+
+    uint64_t next = recover_next_offset(topic_directory(topic));
+    std::lock_guard<std::mutex> lock(mutex);
+    next_offsets.emplace(topic, next);
+    durable_offsets.emplace(topic, next);
+}
+
+/**
+ * @brief Queues a message for the writer thread, never waits for the disk
+ * The record takes the next offset of the topic, so offsets follow the routing order.
+ *
+ * @param topic Topic name, opened with open_topic
+ * @param key Partition key, empty for unkeyed messages
+ * @param payload Payload as published
+ */
+void Archive::append(const std::string &topic, const std::string &key, const std::string &payload)
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    ArchiveRecord record{topic, 0, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count()), key, payload};
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto next = next_offsets.find(topic);
+        if (!running || next == next_offsets.end() || queue.size() >= ARCHIVE_QUEUE_LIMIT)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        record.offset = next->second++;
+        queue.push_back(std::move(record));
+        wake = queue.size() == ARCHIVE_QUEUE_LIMIT / 2;
+    }
+
+    // The thread wakes every flush interval on its own, only a filling queue hurries it
+    if (wake)
+        wakeup.notify_one();
+}
+
+/**
+ * @brief Offset the next archived record of a topic gets
+ */
+uint64_t Archive::next_offset(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto next = next_offsets.find(topic);
+    return next == next_offsets.end() ? 0 : next->second;
+}
+
+/**
+ * @brief Offset up to which the records of a topic are written to its segments
+ */
+uint64_t Archive::durable_offset(const std::string &topic)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto written = durable_offsets.find(topic);
+    return written == durable_offsets.end() ? 0 : written->second;
+}
+
+/**
+ * @brief Hurries the writer thread and waits until the records of a topic before an offset are written
+ *
+ * @param topic Topic name
+ * @param offset Offset the written records must reach
+ * @param timeout Longest wait
+ * @return true Records are written, false on timeout or when some of them were lost
+ */
+bool Archive::wait_durable(const std::string &topic, uint64_t offset, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    flush_requested = true;
+    wakeup.notify_one();
+    return durable.wait_for(lock, timeout, [&]
+                            { auto written = durable_offsets.find(topic);
+                              return written != durable_offsets.end() && written->second >= offset; });
+}
+
+/**
+ * @brief Reads archived records of a topic in offset order, starting at a cursor
+ * Only records already written by the writer thread are seen, a partly written tail ends the read.
+ * Tiered segments are read from the cold directory.
+ *
+ * @param topic Topic name
+ * @param cursor Replay position, moved past every record handed to the callback
+ * @param end_offset Offset at which to stop
+ * @param callback Called for every record from the cursor up to end_offset, may throw
+ * @return size_t Records handed to the callback
+ */
+size_t Archive::replay(const std::string &topic, ArchiveCursor &cursor, uint64_t end_offset,
+                       const std::function<void(const ArchiveRecordView &)> &callback)
+{
+    std::string hot = topic_directory(topic);
+    std::string cold = cold_directory.empty() ? "" : cold_directory + "/" + topic;
+    std::vector<uint64_t> segments = list_archive_segments(hot);
+    if (!cold.empty())
+    {
+        // A segment being tiered shows up in both directories for a moment
+        std::vector<uint64_t> tiered = list_archive_segments(cold, ".logz");
+        segments.insert(segments.end(), tiered.begin(), tiered.end());
+        std::sort(segments.begin(), segments.end());
+        segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+    }
+    if (segments.empty())
+        return 0;
+
+    uint64_t position = 0;
+    size_t delivered = 0;
+    std::vector<char> chunk(ARCHIVE_READ_CHUNK);
+    for (size_t segment = seek_archive(hot, segments, cursor, position); segment < segments.size(); ++segment, position = 0)
+    {
+        SegmentSource source(cache);
+        if (!source.open(hot + "/" + archive_segment_name(segments[segment]),
+                         cold.empty() ? "" : cold + "/" + archive_cold_name(segments[segment])))
+            continue;
+
+        // chunk holds the segment from position, filled bytes of it
+        size_t filled = 0;
+        while (true)
+        {
+            ssize_t result = source.read(chunk.data() + filled, chunk.size() - filled, position + filled);
+            if (result > 0)
+                filled += static_cast<size_t>(result);
+
+            size_t parsed = 0;
+            ArchiveRecordView record;
+            while (size_t length = parse_archive_record(chunk.data() + parsed, filled - parsed, record))
+            {
+                parsed += length;
+                if (record.offset >= end_offset)
+                    return delivered;
+                if (cursor.by_offset ? record.offset < cursor.offset : record.timestamp_ms < cursor.timestamp_ms)
+                    continue;
+
+                callback(record);
+                delivered++;
+                cursor.by_offset = true;
+                cursor.offset = record.offset + 1;
+            }
+
+            // End of the file, or the end marker or a torn record that a full chunk did not complete
+            if (result <= 0 || parsed == 0)
+                break;
+            std::memmove(chunk.data(), chunk.data() + parsed, filled - parsed);
+            filled -= parsed;
+            position += parsed;
+        }
+    }
+    return delivered;
+}
+
+/**
+ * @brief Tiering thread, looks for cold segments once per check interval
+ */
+void Archive::tier()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        tier_wakeup.wait_for(lock, std::chrono::milliseconds(ARCHIVE_TIER_CHECK_MS), [this]
+                             { return !running; });
+        if (!running)
+            break;
+        lock.unlock();
+
+        std::vector<std::string> topics;
+        if (DIR *dir = opendir(directory.c_str()))
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                if (entry->d_name[0] != '.')
+                    topics.push_back(entry->d_name);
+            }
+            closedir(dir);
+        }
+        for (const auto &topic : topics)
+            tier_topic(topic);
+
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Compresses the closed segments of a topic not written for the cold age into the cold directory
+ * The newest segment is never moved, the writer appends to it. The hot file is removed once its
+ * compressed copy is on disk, its index stays in the hot directory.
+ *
+ * @param topic Topic name
+ */
+void Archive::tier_topic(const std::string &topic)
+{
+    std::string hot = topic_directory(topic);
+    std::vector<uint64_t> segments = list_archive_segments(hot);
+    if (segments.size() < 2)
+        return;
+    segments.pop_back();
+
+    std::string cold = cold_directory + "/" + topic;
+    std::time_t now = std::time(nullptr);
+    for (uint64_t base : segments)
+    {
+        std::string path = hot + "/" + archive_segment_name(base);
+        struct stat status;
+        if (stat(path.c_str(), &status) != 0 || now - status.st_mtime < cold_age.count())
+            continue;
+
+        std::string error, target = cold + "/" + archive_cold_name(base);
+        struct stat packed;
+        if ((mkdir(cold.c_str(), 0755) != 0 && errno != EEXIST) || !compress_archive_segment(path, target, error) ||
+            stat(target.c_str(), &packed) != 0)
+        {
+            std::cerr << "[ARCHIVE] " << topic << ": " << (error.empty() ? "cannot create " + cold : error) << std::endl;
+            return;
+        }
+        unlink(path.c_str());
+        std::cerr << "[ARCHIVE] " << topic << ": " << archive_segment_name(base) << " moved to the cold tier, "
+                  << status.st_size << " -> " << packed.st_size << " bytes" << std::endl;
+    }
+}
+
+/**
+ * @brief Writer thread, takes the queue as one batch per flush interval
+ */
+void Archive::run()
+{
+    while (true)
+    {
+        std::deque<ArchiveRecord> batch;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait_for(lock, std::chrono::milliseconds(ARCHIVE_FLUSH_MS), [this]
+                            { return !running || flush_requested || queue.size() >= ARCHIVE_QUEUE_LIMIT / 2; });
+            batch.swap(queue);
+            flush_requested = false;
+            stopping = !running;
+        }
+
+        write(batch);
+        if (stopping)
+            break;
+    }
+
+    writers.clear();
+}
+
+/**
+ * @brief Appends a batch to the segments of its topics and flushes every touched topic
+ *
+ * @param batch Records in routing order
+ */
+void Archive::write(std::deque<ArchiveRecord> &batch)
+{
+    std::string error;
+    std::vector<std::pair<std::string, ArchiveSegmentWriter *>> touched;
+    std::unordered_map<std::string, uint64_t> appended;
+    for (const auto &record : batch)
+    {
+        auto &writer = writers[record.topic];
+        if (!writer)
+        {
+            writer = std::make_unique<ArchiveSegmentWriter>(directory + "/" + record.topic, segment_bytes);
+            if (!writer->open(error))
+            {
+                std::cerr << "[ARCHIVE] " << record.topic << ": " << error << std::endl;
+                writers.erase(record.topic);
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+        }
+
+        if (!writer->append(record, error))
+        {
+            std::cerr << "[ARCHIVE] " << record.topic << ": " << error << std::endl;
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            // A writer left without a segment is reopened from disk by the next record
+            if (!writer->is_open())
+            {
+                touched.erase(std::remove_if(touched.begin(), touched.end(), [&](const auto &entry)
+                                             { return entry.second == writer.get(); }),
+                              touched.end());
+                writers.erase(record.topic);
+            }
+            continue;
+        }
+        appended[record.topic]++;
+        if (std::find_if(touched.begin(), touched.end(), [&](const auto &entry)
+                         { return entry.second == writer.get(); }) == touched.end())
+            touched.emplace_back(record.topic, writer.get());
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> written;
+    for (const auto &entry : touched)
+    {
+        if (entry.second->flush(error))
+        {
+            written.emplace_back(entry.first, entry.second->get_end_offset());
+            continue;
+        }
+
+        // The durable offset stays put, the records of this batch count as dropped and the
+        // writer is reopened from what actually reached the disk
+        std::cerr << "[ARCHIVE] " << entry.first << ": " << error << std::endl;
+        dropped.fetch_add(appended[entry.first], std::memory_order_relaxed);
+        writers.erase(entry.first);
+    }
+
+    if (!written.empty())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &entry : written)
+            durable_offsets[entry.first] = entry.second;
+    }
+    durable.notify_all();
+
+    uint64_t lost = dropped.load(std::memory_order_relaxed);
+    if (lost != dropped_reported)
+    {
+        std::cerr << "[ARCHIVE] " << lost - dropped_reported << " records dropped, " << lost << " in total" << std::endl;
+        dropped_reported = lost;
+    }
+}
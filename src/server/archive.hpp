@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Direct I/O writes whole blocks from buffers aligned to them
+#define ARCHIVE_BLOCK_SIZE 4096
+#define ARCHIVE_BUFFER_SIZE (1 << 20)
+// Records waiting for the writer thread before new ones are dropped
+#define ARCHIVE_QUEUE_LIMIT 65536
+// Longest time an appended record waits before it is written
+#define ARCHIVE_FLUSH_MS 50
+// size, crc, offset, timestamp, key length
+#define ARCHIVE_RECORD_HEADER 26
+// Segment bytes between two entries of the sparse index
+#define ARCHIVE_INDEX_INTERVAL (64 * 1024)
+// max timestamp before, offset, position
+#define ARCHIVE_INDEX_ENTRY 24
+// Bytes a replay reads from a segment at once
+#define ARCHIVE_READ_CHUNK (1 << 20)
+// Cold tier: segment bytes per compressed block, decompressed blocks kept for replays, check interval
+#define ARCHIVE_COLD_BLOCK_SIZE (256 * 1024)
+#define ARCHIVE_CACHE_BLOCKS 64
+#define ARCHIVE_TIER_CHECK_MS 1000
+// table position, block count, block size, segment size, magic
+#define ARCHIVE_COLD_FOOTER 28
+#define ARCHIVE_COLD_MAGIC 0x315a5254
+
+/**
+ * @brief Message handed to the archive by the routing threads
+ */
+struct ArchiveRecord
+{
+    std::string topic;
+    uint64_t offset = 0;
+    uint64_t timestamp_ms = 0;
+    std::string key;
+    std::string payload;
+};
+
+/**
+ * @brief One record read back from a segment, pointing into the segment bytes
+ * Layout, integers little endian:
+ *   0  record size (4)  4  CRC-32 of the bytes after it (4)  8  offset (8)  16 timestamp in ms (8)
+ *   24 key length (2)   26 key, then the payload up to the record size
+ * A record size of 0 marks the end of the written part of a segment.
+ */
+struct ArchiveRecordView
+{
+    uint64_t offset = 0;
+    uint64_t timestamp_ms = 0;
+    const char *key = nullptr;
+    size_t key_size = 0;
+    const char *payload = nullptr;
+    size_t payload_size = 0;
+};
+
+/**
+ * @brief Entry of the sparse index kept next to every segment in <first offset>.idx
+ * Segments get an entry for their first record and then one every ARCHIVE_INDEX_INTERVAL bytes.
+ * max_timestamp_ms is the latest timestamp of all records of the topic before the entry, so it
+ * never decreases and every record in front of an entry below a time is older than that time.
+ */
+struct ArchiveIndexEntry
+{
+    uint64_t max_timestamp_ms = 0;
+    uint64_t offset = 0;
+    uint64_t position = 0;
+};
+
+/**
+ * @brief Where a replay continues: the first record at or after a time, then by offset once one was read
+ */
+struct ArchiveCursor
+{
+    uint64_t timestamp_ms = 0;
+    bool by_offset = false;
+    uint64_t offset = 0;
+};
+
+size_t parse_archive_record(const char *data, size_t size, ArchiveRecordView &record);
+std::string encode_archive_record(const ArchiveRecord &record);
+std::string archive_segment_name(uint64_t base_offset);
+std::string archive_index_name(uint64_t base_offset);
+std::string archive_cold_name(uint64_t base_offset);
+std::vector<uint64_t> list_archive_segments(const std::string &directory, const std::string &extension = ".log");
+std::vector<ArchiveIndexEntry> load_archive_index(const std::string &path, size_t max_entries = SIZE_MAX);
+bool compress_archive_segment(const std::string &source, const std::string &target, std::string &error);
+
+/**
+ * @brief Least recently used decompressed blocks of cold segments, shared by all replays
+ */
+class ArchiveBlockCache
+{
+public:
+    explicit ArchiveBlockCache(size_t capacity) : capacity(capacity) {}
+
+    std::shared_ptr<const std::string> get(const std::string &key);
+    void put(const std::string &key, std::shared_ptr<const std::string> block);
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const std::string>>;
+
+    size_t capacity;
+    std::mutex mutex;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> lookup;
+};
+
+/**
+ * @brief Appends the records of one topic to rotating segment files named after their first offset
+ * Records collect in a block aligned buffer that is written with direct I/O when the file system
+ * supports it. The partial last block is rewritten by the next flush, a closed segment is trimmed
+ * to its records. The sparse index grows with the appends and is written after the records it
+ * points to. Reopening recovers the end and the index of the newest segment. Only used by the
+ * archive thread.
+ */
+class ArchiveSegmentWriter
+{
+public:
+    ArchiveSegmentWriter(const std::string &directory, size_t segment_bytes);
+    ~ArchiveSegmentWriter();
+
+    ArchiveSegmentWriter(const ArchiveSegmentWriter &) = delete;
+    ArchiveSegmentWriter &operator=(const ArchiveSegmentWriter &) = delete;
+
+    bool open(std::string &error);
+    bool append(const ArchiveRecord &record, std::string &error);
+    bool flush(std::string &error);
+    void close();
+
+    uint64_t get_end_offset() const { return end_offset; }
+    bool is_open() const { return fd >= 0; }
+
+private:
+    void index_record(size_t position, uint64_t offset, uint64_t timestamp_ms);
+    bool open_segment(uint64_t base_offset, size_t size, std::string &error);
+    bool close_segment(std::string &error);
+    bool write_buffer(size_t length, std::string &error);
+    bool write_index(std::string &error);
+
+    std::string directory;
+    size_t segment_bytes;
+    int fd = -1;
+    bool direct = false;
+    uint64_t end_offset = 0;
+    uint64_t segment_base = 0;
+
+    // Index entries not written yet, the position of the last entry and the latest timestamp so far
+    int index_fd = -1;
+    std::string index_pending;
+    size_t last_indexed = 0;
+    uint64_t max_timestamp = 0;
+
+    // Buffer holds the file from buffer_start, a block boundary, up to the end of the last record
+    std::unique_ptr<char, void (*)(void *)> buffer;
+    size_t buffer_start = 0;
+    size_t buffer_used = 0;
+    bool dirty = false;
+};
+
+/**
+ * @brief Server side sink writing archived topics to <directory>/<topic>/<first offset>.log
+ * Routing threads only queue records and take the next offset of the topic. A dedicated thread
+ * writes them, so disk latency never holds up fan-out. A full queue drops records and counts them.
+ * A topic is opened once, outside the routing path, to recover its next offset from disk.
+ * With a cold tier, a second thread compresses closed segments older than the cold age into
+ * <cold directory>/<topic>/<first offset>.logz, replays read them through the block cache.
+ */
+class Archive
+{
+public:
+    Archive(const std::string &directory, size_t segment_bytes);
+    ~Archive();
+
+    Archive(const Archive &) = delete;
+    Archive &operator=(const Archive &) = delete;
+
+    void set_cold_tier(const std::string &directory, std::chrono::seconds age);
+    bool start(std::string &error);
+    void stop();
+    void open_topic(const std::string &topic);
+    void append(const std::string &topic, const std::string &key, const std::string &payload);
+
+    uint64_t next_offset(const std::string &topic);
+    uint64_t durable_offset(const std::string &topic);
+    bool wait_durable(const std::string &topic, uint64_t offset, std::chrono::milliseconds timeout);
+    size_t replay(const std::string &topic, ArchiveCursor &cursor, uint64_t end_offset,
+                  const std::function<void(const ArchiveRecordView &)> &callback);
+
+    std::string topic_directory(const std::string &topic) const { return directory + "/" + topic; }
+    uint64_t get_dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    void write(std::deque<ArchiveRecord> &batch);
+    void tier();
+    void tier_topic(const std::string &topic);
+
+    std::string directory;
+    size_t segment_bytes;
+    std::string cold_directory;
+    std::chrono::seconds cold_age{0};
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<ArchiveRecord> queue;
+    bool running = false;
+    bool flush_requested = false;
+
+    // Offset the next record of a topic gets, and the offset up to which its records are on disk
+    std::unordered_map<std::string, uint64_t> next_offsets;
+    std::unordered_map<std::string, uint64_t> durable_offsets;
+    std::condition_variable durable;
+    std::thread worker;
+    std::thread tier_worker;
+    std::condition_variable tier_wakeup;
+    std::atomic<uint64_t> dropped{0};
+    ArchiveBlockCache cache{ARCHIVE_CACHE_BLOCKS};
+
+    // Writers by topic, only used by the archive thread
+    std::unordered_map<std::string, std::unique_ptr<ArchiveSegmentWriter>> writers;
+    uint64_t dropped_reported = 0;
+};
@@ -0,0 +1,132 @@
+#include "dictionary_trainer.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+// Length of the substrings whose recurrence is counted
+#define TRAINER_KGRAM 8
+// Length of the candidate segments copied into the dictionary
+#define TRAINER_SEGMENT 32
+
+/**
+ * @brief Construct a new Dictionary Trainer
+ *
+ * @param max_samples Samples collected before a dictionary can be trained
+ * @param dictionary_size Upper bound of the dictionary length
+ */
+DictionaryTrainer::DictionaryTrainer(size_t max_samples, size_t dictionary_size)
+    : max_samples(max_samples), dictionary_size(dictionary_size)
+{
+    samples.reserve(max_samples);
+}
+
+/**
+ * @brief Adds a sampled message
+ *
+ * @param sample Message payload
+ * @return true Enough samples are collected to train
+ */
+bool DictionaryTrainer::add(const std::string &sample)
+{
+    if (samples.size() < max_samples)
+        samples.push_back(sample);
+    return samples.size() >= max_samples;
+}
+
+/**
+ * @brief Trains a dictionary from the collected samples and starts a new collection
+ *
+ * @return std::string Dictionary, empty if the samples share no structure
+ */
+std::string DictionaryTrainer::train()
+{
+    // K-grams are interned once, scoring then only touches integer counters
+    std::unordered_map<std::string, uint32_t> ids;
+    std::vector<uint32_t> frequency;
+    std::vector<std::vector<uint32_t>> sample_kgrams;
+    for (const auto &sample : samples)
+    {
+        std::vector<uint32_t> kgrams;
+        std::unordered_set<uint32_t> seen;
+        for (size_t i = 0; i + TRAINER_KGRAM <= sample.size(); ++i)
+        {
+            auto inserted = ids.emplace(sample.substr(i, TRAINER_KGRAM), static_cast<uint32_t>(frequency.size()));
+            if (inserted.second)
+                frequency.push_back(0);
+            uint32_t id = inserted.first->second;
+            kgrams.push_back(id);
+
+            // Count in how many samples a k-gram occurs, repetition inside one sample is deflate's job
+            if (seen.insert(id).second)
+                frequency[id]++;
+        }
+        sample_kgrams.push_back(std::move(kgrams));
+    }
+
+    struct Segment
+    {
+        size_t sample;
+        size_t offset;
+        size_t length;
+    };
+
+    std::vector<Segment> candidates;
+    for (size_t s = 0; s < samples.size(); ++s)
+    {
+        for (size_t offset = 0; offset + TRAINER_KGRAM <= samples[s].size(); offset += TRAINER_SEGMENT / 2)
+        {
+            candidates.push_back({s, offset, std::min<size_t>(TRAINER_SEGMENT, samples[s].size() - offset)});
+        }
+    }
+
+    // Greedy cover, a chosen segment zeroes its k-grams so overlapping candidates lose their value
+    std::vector<std::string> chosen;
+    size_t total = 0;
+    while (total < dictionary_size && !candidates.empty())
+    {
+        size_t best = 0;
+        uint64_t best_score = 0;
+        for (size_t c = 0; c < candidates.size(); ++c)
+        {
+            const Segment &segment = candidates[c];
+            const auto &kgrams = sample_kgrams[segment.sample];
+            uint64_t score = 0;
+            for (size_t i = segment.offset; i + TRAINER_KGRAM <= segment.offset + segment.length; ++i)
+            {
+                if (frequency[kgrams[i]] > 1)
+                    score += frequency[kgrams[i]];
+            }
+            if (score > best_score)
+            {
+                best_score = score;
+                best = c;
+            }
+        }
+
+        if (best_score == 0)
+            break;
+
+        const Segment &segment = candidates[best];
+        const auto &kgrams = sample_kgrams[segment.sample];
+        for (size_t i = segment.offset; i + TRAINER_KGRAM <= segment.offset + segment.length; ++i)
+        {
+            frequency[kgrams[i]] = 0;
+        }
+        chosen.push_back(samples[segment.sample].substr(segment.offset, segment.length));
+        total += segment.length;
+        candidates.erase(candidates.begin() + best);
+    }
+
+    samples.clear();
+
+    // Deflate codes short distances cheaper, so the best segment goes last
+    std::string dictionary;
+    for (auto it = chosen.rbegin(); it != chosen.rend(); ++it)
+    {
+        dictionary += *it;
+    }
+    if (dictionary.size() > dictionary_size)
+        dictionary.erase(0, dictionary.size() - dictionary_size);
+    return dictionary;
+}
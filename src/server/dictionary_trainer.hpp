@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Builds a compression dictionary from sampled messages of a topic
+ * Segments are chosen greedily by how many recurring k-grams they cover that no chosen
+ * segment covers yet, the most valuable ones end up closest to the message.
+ * Not thread safe, callers serialize access.
+ */
+class DictionaryTrainer
+{
+public:
+    DictionaryTrainer(size_t max_samples, size_t dictionary_size);
+
+    bool add(const std::string &sample);
+    std::string train();
+
+    size_t sample_count() const { return samples.size(); }
+
+private:
+    size_t max_samples;
+    size_t dictionary_size;
+    std::vector<std::string> samples;
+};
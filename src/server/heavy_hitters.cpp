@@ -0,0 +1,202 @@
+#include "heavy_hitters.hpp"
+
+#include <algorithm>
+#include <functional>
+
+/**
+ * @brief Construct a new Heavy Hitters tracker
+ *
+ * @param top_k Candidates kept per window
+ * @param width Counters per sketch row
+ * @param depth Sketch rows, each with its own hash
+ * @param window Length of one window
+ * @param windows Number of windows kept, the oldest one is recycled on rotation
+ */
+HeavyHitters::HeavyHitters(size_t top_k, size_t width, size_t depth, std::chrono::seconds window, size_t windows)
+    : top_k(top_k), width(width), depth(depth), window(window), windows(windows)
+{
+    auto now = std::chrono::steady_clock::now();
+    for (auto &w : this->windows)
+    {
+        w.counters.assign(width * depth, 0);
+        w.heap.reserve(top_k);
+        w.start = now;
+    }
+}
+
+/**
+ * @brief Counts an amount for a key in the current window
+ *
+ * @param key Topic or client name
+ * @param amount Messages, bytes or writes to add
+ */
+void HeavyHitters::add(const std::string &key, uint64_t amount)
+{
+    size_t h1 = std::hash<std::string>{}(key);
+    size_t h2 = (h1 >> 32) | 1;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    rotate(std::chrono::steady_clock::now());
+
+    Window &w = windows[current];
+    offer(w, key, increment(w, h1, h2, amount));
+}
+
+/**
+ * @brief Returns the heaviest keys over the most recent windows
+ *
+ * @param n Number of keys to return
+ * @param span Time span to cover, rounded up to whole windows
+ * @return std::vector<std::pair<std::string, uint64_t>> Keys with estimated totals, heaviest first
+ */
+std::vector<std::pair<std::string, uint64_t>> HeavyHitters::top(size_t n, std::chrono::seconds span)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    rotate(std::chrono::steady_clock::now());
+
+    size_t count = std::min(windows.size(), std::max<size_t>(1, (span.count() + window.count() - 1) / window.count()));
+
+    std::unordered_map<std::string, uint64_t> totals;
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (const auto &candidate : windows[(current + windows.size() - i) % windows.size()].heap)
+            totals.emplace(candidate.key, 0);
+    }
+
+    for (auto &total : totals)
+    {
+        size_t h1 = std::hash<std::string>{}(total.first);
+        size_t h2 = (h1 >> 32) | 1;
+        for (size_t i = 0; i < count; ++i)
+            total.second += estimate(windows[(current + windows.size() - i) % windows.size()], h1, h2);
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> result(totals.begin(), totals.end());
+    std::sort(result.begin(), result.end(), [](const auto &a, const auto &b)
+              { return a.second != b.second ? a.second > b.second : a.first < b.first; });
+    if (result.size() > n)
+        result.resize(n);
+    return result;
+}
+
+/**
+ * @brief Advances to the window covering now, clearing windows that fell out of the history
+ *
+ * @param now Current time
+ */
+void HeavyHitters::rotate(std::chrono::steady_clock::time_point now)
+{
+    size_t steps = 0;
+    while (now - windows[current].start >= window && steps <= windows.size())
+    {
+        auto start = windows[current].start + window;
+        current = (current + 1) % windows.size();
+        Window &w = windows[current];
+        std::fill(w.counters.begin(), w.counters.end(), 0);
+        w.heap.clear();
+        w.positions.clear();
+        w.start = start;
+        steps++;
+    }
+
+    // After a long idle period the whole history is stale, restart the clock at now
+    if (steps > windows.size())
+        windows[current].start = now;
+}
+
+/**
+ * @brief Adds to every sketch row and returns the new count-min estimate
+ *
+ */
+uint64_t HeavyHitters::increment(Window &w, size_t h1, size_t h2, uint64_t amount)
+{
+    uint64_t result = UINT64_MAX;
+    for (size_t row = 0; row < depth; ++row)
+    {
+        uint64_t &counter = w.counters[row * width + (h1 + row * h2) % width];
+        counter += amount;
+        result = std::min(result, counter);
+    }
+    return result;
+}
+
+/**
+ * @brief Count-min estimate of a key in a window
+ *
+ */
+uint64_t HeavyHitters::estimate(const Window &w, size_t h1, size_t h2) const
+{
+    uint64_t result = UINT64_MAX;
+    for (size_t row = 0; row < depth; ++row)
+        result = std::min(result, w.counters[row * width + (h1 + row * h2) % width]);
+    return result;
+}
+
+/**
+ * @brief Updates the top-K min-heap with the latest estimate of a key
+ * A new key only replaces the root when its estimate beats the smallest candidate
+ *
+ */
+void HeavyHitters::offer(Window &w, const std::string &key, uint64_t count)
+{
+    auto it = w.positions.find(key);
+    if (it != w.positions.end())
+    {
+        w.heap[it->second].count = count;
+        sift_down(w, it->second);
+        return;
+    }
+
+    if (w.heap.size() < top_k)
+    {
+        w.heap.push_back({key, count});
+        w.positions[key] = w.heap.size() - 1;
+        sift_up(w, w.heap.size() - 1);
+        return;
+    }
+
+    if (count <= w.heap.front().count)
+        return;
+
+    w.positions.erase(w.heap.front().key);
+    w.heap.front() = {key, count};
+    w.positions[key] = 0;
+    sift_down(w, 0);
+}
+
+void HeavyHitters::sift_up(Window &w, size_t index)
+{
+    while (index > 0)
+    {
+        size_t parent = (index - 1) / 2;
+        if (w.heap[parent].count <= w.heap[index].count)
+            break;
+        swap_entries(w, parent, index);
+        index = parent;
+    }
+}
+
+void HeavyHitters::sift_down(Window &w, size_t index)
+{
+    while (true)
+    {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < w.heap.size() && w.heap[left].count < w.heap[smallest].count)
+            smallest = left;
+        if (right < w.heap.size() && w.heap[right].count < w.heap[smallest].count)
+            smallest = right;
+        if (smallest == index)
+            break;
+        swap_entries(w, smallest, index);
+        index = smallest;
+    }
+}
+
+void HeavyHitters::swap_entries(Window &w, size_t a, size_t b)
+{
+    std::swap(w.heap[a], w.heap[b]);
+    w.positions[w.heap[a].key] = a;
+    w.positions[w.heap[b].key] = b;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Streaming heavy hitters over sliding windows
+ * Every window holds a count-min sketch for the estimates and a top-K min-heap of candidates,
+ * so memory stays fixed no matter how many distinct keys are counted.
+ */
+class HeavyHitters
+{
+public:
+    HeavyHitters(size_t top_k, size_t width, size_t depth, std::chrono::seconds window, size_t windows);
+
+    void add(const std::string &key, uint64_t amount);
+    std::vector<std::pair<std::string, uint64_t>> top(size_t n, std::chrono::seconds span);
+
+    std::chrono::seconds window_length() const { return window; }
+    std::chrono::seconds history_length() const { return window * windows.size(); }
+
+private:
+    struct Candidate
+    {
+        std::string key;
+        uint64_t count;
+    };
+
+    struct Window
+    {
+        std::vector<uint64_t> counters;
+        std::vector<Candidate> heap;
+        std::unordered_map<std::string, size_t> positions;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    void rotate(std::chrono::steady_clock::time_point now);
+    uint64_t increment(Window &w, size_t h1, size_t h2, uint64_t amount);
+    uint64_t estimate(const Window &w, size_t h1, size_t h2) const;
+    void offer(Window &w, const std::string &key, uint64_t count);
+    void sift_up(Window &w, size_t index);
+    void sift_down(Window &w, size_t index);
+    void swap_entries(Window &w, size_t a, size_t b);
+
+    size_t top_k;
+    size_t width;
+    size_t depth;
+    std::chrono::seconds window;
+    std::vector<Window> windows;
+    size_t current = 0;
+    std::mutex mutex;
+};
@@ -1,59 +1,585 @@
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <deque>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <atomic>
+#include <set>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <csignal>
+#include <array>
+#include <iomanip>
+#include <cmath>
+#include <ctime>
 #include <boost/asio.hpp>
 #include "argparse/argparse.hpp"
+#include "timer_wheel.hpp"
+#include "heavy_hitters.hpp"
+#include "trace.hpp"
+#include "dictionary_trainer.hpp"
+#include "delta.hpp"
+#include "message_header.hpp"
+#include "dictionary_codec.hpp"
+#include "websocket.hpp"
+#include "tls.hpp"
+#include "acl.hpp"
+#include "archive.hpp"
 
 #define MAX_TOPIC_LENGTH 64
 #define MAX_MESSAGE_LENGTH 1024
+#define MAX_PUBLISH_TOPICS 16
+#define MAX_PARTITIONS 1024
+#define MAX_TRANSACTION_MESSAGES 256
+#define COMMIT_BATCH_MESSAGES 16
+#define MAX_DERIVED_TOPICS 256
+#define MIN_DERIVE_WINDOW_MS 10
+#define MAX_DERIVE_WINDOW_MS 3600000
+
+// Compacted topics: keys kept per topic and keys answered by one GET
+#define MAX_STATE_KEYS 1048576
+#define MAX_GET_KEYS 64
+
+// SUBSCRIBE FROM: bytes of [REPLAY] lines per write and longest wait for the archive to catch up
+#define REPLAY_BATCH_BYTES (64 * 1024)
+#define REPLAY_SYNC_TIMEOUT_MS 1000
+#define MAX_COMMAND_LENGTH (MAX_MESSAGE_LENGTH + MAX_PUBLISH_TOPICS * (MAX_TOPIC_LENGTH + 1) + 4 * ((MAX_HEADER_SIZE + 2) / 3) + 64)
+
+// Heavy hitter tracking, memory is fixed by these regardless of topic count
+#define TOP_K_CANDIDATES 64
+#define SKETCH_WIDTH 2048
+#define SKETCH_DEPTH 4
+#define LOAD_WINDOW_SECONDS 10
+#define LOAD_WINDOWS 6
+
+// Per-topic dictionary compression: samples per training round and dictionary length
+#define DICT_SAMPLES 64
+#define DICT_SIZE 4096
+
+// Session handles: low bits index the session table, high bits hold the slot generation
+#define SESSION_INDEX_BITS 20
+#define SESSION_INDEX_MASK ((1u << SESSION_INDEX_BITS) - 1)
+#define SESSION_GENERATION_MASK ((1u << (32 - SESSION_INDEX_BITS)) - 1)
 
 using boost::asio::ip::tcp;
-using CommandHandler = std::function<void(std::shared_ptr<tcp::socket>, const std::string &)>;
-struct ClientInfo
+using SessionHandle = uint32_t;
+
+struct Session;
+struct SubscriberGroup;
+using CommandHandler = std::function<void(Session &, const std::string &)>;
+
+/**
+ * @brief Encoded message shared by all subscribers, carries the trace id of sampled messages
+ * Frames of a message with a TTL are dropped instead of written once they expire in a backlog
+ */
+struct FrameData
 {
-    std::shared_ptr<tcp::socket> socket;
-    std::string name;
-    int pid;
+    std::string data;
+    uint64_t trace_id = 0;
+    std::chrono::steady_clock::time_point expires = std::chrono::steady_clock::time_point::max();
+    // Frames later frames depend on, like dictionaries, are never dropped by the slow consumer policy
+    bool control = false;
+};
+using Frame = std::shared_ptr<const FrameData>;
+
+/**
+ * @brief Optional protocol features a session enables with ENABLE <feature>
+ */
+enum SessionFeature : uint32_t
+{
+    FeatureAliases = 1u << 0,
+    FeatureDelta = 1u << 1,
+    FeatureCompress = 1u << 2,
+    FeatureHeaders = 1u << 5,
+    // Transport of the session, set on acquire
+    FeatureWebSocket = 1u << 3,
+    FeatureEventStream = 1u << 4,
+};
+
+enum class SlowConsumerPolicy
+{
+    DropOldest,
+    DropNewest,
+    Disconnect
 };
 
 struct ClientMetadata
 {
     std::string name;
     std::string ip;
-    int client_pid;
-    int client_port;
-    int server_port;
+    int client_pid = 0;
+    int client_port = 0;
+    int server_port = 0;
+};
+
+/**
+ * @brief Routing data travelling next to a payload, from KPUBLISH or the header block of HPUBLISH
+ */
+struct PublishMeta
+{
+    std::string key;       // Partition key, empty for unkeyed messages
+    std::string header;    // Base64 header block forwarded to FeatureHeaders sessions, empty without one
+    uint32_t ttl_ms = 0;   // Frames still queued after this many ms are dropped, 0 for no limit
+    uint64_t trace_id = 0; // Trace id chosen by the publisher, 0 to let the tracer sample
+};
+
+/**
+ * @brief Publish buffered by an open transaction until COMMIT
+ */
+struct PendingPublish
+{
+    std::vector<std::string> topics;
+    std::string payload;
+    PublishMeta meta;
+};
+
+/**
+ * @brief Credit window granted by a subscriber
+ * Frames are only written while credit is left, the rest waits in a bounded backlog.
+ * While a replay is being sent every live frame waits in the backlog, with or without credit.
+ */
+struct FlowControl
+{
+    uint64_t message_credit = 0;
+    uint64_t byte_credit = 0;
+    bool byte_limited = false;
+    bool draining = false;
+    bool replaying = false;
+    std::deque<Frame> backlog;
+    size_t backlog_bytes = 0;
+
+    bool has_credit(size_t bytes) const
+    {
+        return message_credit > 0 && (!byte_limited || byte_credit >= bytes);
+    }
+
+    void consume(size_t bytes)
+    {
+        message_credit--;
+        if (byte_limited)
+            byte_credit -= bytes;
+    }
+};
+
+/**
+ * @brief Delta encoded stream of one topic towards one session
+ * A delta is only valid if the session got the previous version and nothing was dropped since
+ */
+struct DeltaStream
+{
+    uint64_t version = 0;
+    uint64_t dropped = 0;
+};
+
+/**
+ * @brief Slot of the session table, one per accepted connection
+ * Slots are reused, the generation is bumped on release so handles of a previous owner go stale
+ */
+struct Session
+{
+    SessionHandle handle = 0;
+    std::atomic<uint32_t> generation{0};
+    std::shared_ptr<tcp::socket> socket;
+
+    // TLS of the connection, null for plaintext. Set before the first write, reset under write_mutex
+    std::unique_ptr<TlsConnection> tls;
+
+    // Client identity, guarded by client_mutex
+    bool connected = false;
+    std::string name;
+    int pid = 0;
+
+    // Subscribed topics, group of the full rate ones and interest registration, guarded by topic_mutex
+    std::set<std::string> topics;
+    SubscriberGroup *group = nullptr;
+    size_t group_slot = 0;
+    bool interest = false;
+
+    // SessionFeature bits, changed under topic_mutex and read lock-free during fan-out
+    std::atomic<uint32_t> features{0};
+
+    // Delta streams by topic, guarded by topic_mutex
+    std::unordered_map<std::string, DeltaStream> delta_streams;
+
+    // Consumer group of each topic subscribed with GROUP, guarded by topic_mutex
+    std::unordered_map<std::string, std::string> consumer_groups;
+
+    // Publishes buffered between BEGIN and COMMIT, only used by the handler thread
+    bool in_transaction = false;
+    bool transaction_failed = false;
+    std::vector<PendingPublish> transaction;
+
+    // Permissions by topic id, compiled on CONNECT and resolved lazily, guarded by acl_mutex
+    std::mutex acl_mutex;
+    SessionAcl acl;
+
+    // Serializes writes of the handler thread, publishers and timers
+    std::mutex write_mutex;
+
+    // Credit window, guarded by flow_mutex
+    std::mutex flow_mutex;
+    bool flow_enabled = false;
+    FlowControl flow;
+
+    // Frames dropped by the slow consumer policy, a change forces keyframes on delta streams
+    std::atomic<uint64_t> frames_dropped{0};
+};
+
+/**
+ * @brief Rate limiting and sampling state of one subscription
+ * The conflation slot keeps only the latest frame until the interval elapses
+ */
+struct Downsampler
+{
+    std::chrono::milliseconds interval{0};
+    uint32_t sample_every = 1;
+    uint32_t sample_counter = 0;
+    std::chrono::steady_clock::time_point next_send;
+    Frame conflated;
+    bool flush_scheduled = false;
+    std::mutex mutex;
+};
+
+/**
+ * @brief Entry of a topic subscriber list for a rate limited or sampled subscription
+ */
+struct Subscriber
+{
+    SessionHandle session;
+    std::shared_ptr<Downsampler> sampling;
+};
+
+/**
+ * @brief Sessions with an identical set of full rate subscriptions
+ * Topics route to the group once instead of to every member
+ */
+struct SubscriberGroup
+{
+    std::string key;
+    std::set<std::string> topics;
+    std::vector<SessionHandle> members;
+};
+
+/**
+ * @brief Consumer group of a topic, every message goes to the one member owning its partition
+ * Members keep their join order, partition p is owned by members[p % members.size()]
+ */
+struct ConsumerGroup
+{
+    std::string name;
+    std::vector<SessionHandle> members;
+};
+
+/**
+ * @brief Aggregate a derived topic computes over each window of its source
+ */
+enum class DeriveOperator
+{
+    Count, // Number of messages
+    Min,   // Smallest numeric message
+    Max,   // Largest numeric message
+    Mean,  // Mean of the numeric messages
+    Last   // Latest message as published
+};
+
+/**
+ * @brief Server side subscriber of a source topic that publishes one aggregate per window as its own topic
+ * The aggregate is updated once per source message and reset when the window closes, guarded by topic_mutex
+ */
+struct DerivedTopic
+{
+    std::string name;
+    std::string source;
+    DeriveOperator op = DeriveOperator::Count;
+    std::chrono::milliseconds window{0};
+    std::chrono::steady_clock::time_point closes;
+
+    uint64_t messages = 0;
+    uint64_t numbers = 0;
+    double min = 0;
+    double max = 0;
+    double sum = 0;
+    std::string last;
+};
+
+/**
+ * @brief Latest payload per key of a compacted topic, read by GET without taking topic_mutex
+ * fan_out writes it under topic_mutex, its own mutex guards the values against concurrent lookups
+ */
+struct StateTable
+{
+    uint32_t alias = 0;
+    std::mutex mutex;
+    std::unordered_map<std::string, std::string> values;
+};
+
+/**
+ * @brief Routing entry of a topic, sessions counts every subscriber of both lists
+ * Delta encoded topics keep the last payload as the base of the next version
+ */
+struct TopicRoute
+{
+    uint32_t alias = 0;
+    std::vector<SubscriberGroup *> groups;
+    std::vector<Subscriber> sampled;
+    size_t sessions = 0;
+
+    uint32_t keyframe_every = 0;
+    uint64_t version = 0;
+    std::string last_payload;
+
+    // Key partitions shared by the consumer groups, unkeyed messages rotate over them
+    uint32_t partitions = 1;
+    uint64_t next_partition = 0;
+    std::vector<ConsumerGroup> consumer_groups;
+
+    // Derived topics aggregating this topic, archiving and compaction keep it interesting to publishers like subscribers do
+    std::vector<std::shared_ptr<DerivedTopic>> derived;
+    bool archived = false;
+    std::shared_ptr<StateTable> state;
+
+    // Dictionary compression, retrain_every is 0 unless the topic is compressed
+    uint32_t retrain_every = 0;
+    uint64_t dictionary_counter = 0;
+    std::shared_ptr<DictionaryTrainer> trainer;
+    // A training round runs off the routing path, results of an older COMPRESS setting are discarded
+    bool training = false;
+    uint64_t compress_generation = 0;
+    uint32_t dictionary_version = 0;
+    std::string dictionary;
+    Frame dictionary_frame;
+};
+
+/**
+ * @brief Message encodings a subscriber can ask for through its features
+ */
+enum FrameEncoding
+{
+    EncodingText,       // [Message] Topic: <topic> Data: <payload>
+    EncodingCompact,    // #<alias> <payload>
+    EncodingKeyframe,   // [KEY] <topic> <version> <payload>
+    EncodingDelta,      // [DELTA] <topic> <version> <base> <operations>
+    EncodingCompressed, // [Z] <topic> <dictionary version> <length> + deflated bytes
+    EncodingHeaders,    // [HMessage] Topic: <topic> Header: <header> Data: <payload>
+    EncodingCount
+};
+
+/**
+ * @brief Connection types an encoding is written to
+ */
+enum FrameTransport
+{
+    TransportStream,      // Plain TCP, newline terminated
+    TransportWebSocket,   // One WebSocket message per frame
+    TransportEventStream, // Server-Sent Events data event
+    TransportCount
+};
+
+/**
+ * @brief Wire formats of one published message, each built on first need during fan-out
+ * A format is an encoding written for a transport. Formats are shared by reference with every
+ * later subscriber asking for the same one, so the cost follows the number of formats in use.
+ * Encodings that would not shrink fall back: deltas to the keyframe, compressed frames to the plain encoding.
+ * Messages with a header block go to FeatureHeaders sessions as EncodingHeaders, all others never see the header.
+ */
+struct FrameCache
+{
+    FrameCache(TopicRoute &route, const std::string &topic, const std::string &payload, const PublishMeta &meta, uint64_t trace_id);
+
+    const Frame &for_session(SessionHandle handle);
+    const Frame &for_sampled(SessionHandle handle);
+
+    const std::string &topic;
+    const std::string &payload;
+    const std::string &header;
+    uint64_t trace_id;
+    std::chrono::steady_clock::time_point expires = std::chrono::steady_clock::time_point::max();
+    uint32_t alias;
+
+    // Version of a delta encoded topic, 0 otherwise
+    uint64_t version = 0;
+    bool keyframe_only = true;
+    std::string base;
+
+    // Dictionary of a compressed topic, null otherwise
+    const std::string *dictionary = nullptr;
+    uint32_t dictionary_version = 0;
+
+    std::array<Frame, EncodingCount * TransportCount> frames;
+
+private:
+    bool with_header(uint32_t features) const { return !header.empty() && (features & FeatureHeaders); }
+    FrameEncoding plain_encoding(uint32_t features);
+    const Frame &frame(FrameEncoding encoding, uint32_t features);
+    std::string encode(FrameEncoding encoding);
+};
+
+/**
+ * @brief Load counters of one dimension (topics or clients)
+ */
+struct LoadTracker
+{
+    HeavyHitters messages{TOP_K_CANDIDATES, SKETCH_WIDTH, SKETCH_DEPTH, std::chrono::seconds(LOAD_WINDOW_SECONDS), LOAD_WINDOWS};
+    HeavyHitters bytes{TOP_K_CANDIDATES, SKETCH_WIDTH, SKETCH_DEPTH, std::chrono::seconds(LOAD_WINDOW_SECONDS), LOAD_WINDOWS};
+    HeavyHitters fanout{TOP_K_CANDIDATES, SKETCH_WIDTH, SKETCH_DEPTH, std::chrono::seconds(LOAD_WINDOW_SECONDS), LOAD_WINDOWS};
 };
 
-// Maps for storing client info and topic subscriptions
-std::unordered_map<std::shared_ptr<tcp::socket>, ClientInfo> connected_clients;
-std::unordered_map<std::string, std::vector<std::shared_ptr<tcp::socket>>> topic_subscribers;
+// Session table, preallocated so fan-out can resolve handles without locking or refcounting
+std::unique_ptr<Session[]> sessions;
+size_t max_sessions = 65536;
+std::vector<uint32_t> free_sessions;
+
+// Maps for storing client names, topic subscriptions and subscriber groups keyed by their topic set
+std::unordered_map<std::string, SessionHandle> client_names;
+std::unordered_map<std::string, TopicRoute> topic_subscribers;
+std::unordered_map<std::string, std::unique_ptr<SubscriberGroup>> subscriber_groups;
+
+// Topic names by alias, aliases are assigned once per topic and shared by all sessions
+std::vector<std::string> alias_topics;
+
+// Routes are never erased, commands creating them stop at this many topics
+size_t max_topics = 65536;
+
+// Compresses messages of all compressed topics, guarded by topic_mutex
+DictionaryCompressor compressor;
+
+// Publishers registered for interest updates, guarded by topic_mutex
+std::vector<SessionHandle> interest_listeners;
+
+// Slow consumer handling for credit based subscribers
+SlowConsumerPolicy slow_consumer_policy = SlowConsumerPolicy::DropOldest;
+size_t max_backlog = 1024;
+
+// Heaviest topics and publishing clients
+LoadTracker topic_load, client_load;
+
+// Sampled message tracing, disabled unless --trace-sample is set
+Tracer tracer(1 << 16);
+std::string trace_file = "trace.json";
+thread_local uint64_t read_timestamp = 0;
+
+// Drives conflation flushes of rate limited subscriptions
+TimerWheel timer_wheel(std::chrono::milliseconds(5), 1024);
+
+// Sink of archived topics, null unless --archive-dir is set
+std::unique_ptr<Archive> archive;
+
+// State tables of compacted topics by name for GET, the map is guarded by state_mutex
+std::mutex state_mutex;
+std::unordered_map<std::string, std::shared_ptr<StateTable>> state_tables;
+
+// Topics of transactions being committed, other publishes and subscriptions to them wait, guarded by topic_mutex
+std::unordered_set<std::string> fenced_topics;
+std::condition_variable fences_lifted;
+
+// Derived topics by name, guarded by topic_mutex
+std::unordered_map<std::string, std::shared_ptr<DerivedTopic>> derived_topics;
+
+// Rules of the ACL file, null when every client may publish and subscribe to every topic
+std::unique_ptr<AclRules> acl_rules;
+
+// TLS of the TCP listener, null when it serves plaintext
+std::unique_ptr<TlsContext> tls_context;
+
+// Runs the read watches of event stream sessions, which hold no thread of their own
+boost::asio::io_context http_io_context;
 
 // Command handler map
 std::unordered_map<std::string, CommandHandler> command_handlers;
 
 // Mutexes
-std::mutex topic_mutex, client_mutex;
+std::mutex topic_mutex, client_mutex, session_mutex;
 
 // Function declarations
 void start_server(boost::asio::io_context &io_context, int port);
 void client_handler(std::shared_ptr<tcp::socket> socket);
+void dispatch_command(Session &session, const std::string &message);
+void start_http_server(int port);
+void http_client_handler(std::shared_ptr<tcp::socket> socket);
+void websocket_handler(Session &session, const std::string &leftover);
+void send_websocket_control(Session &session, const std::string &payload, WebSocketOpcode opcode);
+void start_event_stream(std::shared_ptr<tcp::socket> socket, const std::string &topic);
+void watch_event_stream(Session &session, SessionHandle handle);
+
+Session *acquire_session(std::shared_ptr<tcp::socket> socket, uint32_t transport = 0);
+void release_session(Session &session);
+Session *resolve_session(SessionHandle handle);
+bool is_current(const Session &session, SessionHandle handle);
+void unsubscribe_all(Session &session);
+void set_full_rate(Session &session, const std::string &topic, bool subscribed);
+void move_to_group(Session &session, std::set<std::string> topics);
+void notify_interest(const std::string &topic, bool active);
+TopicRoute &route_for(const std::string &topic);
+bool can_route(Session &session, std::initializer_list<std::string> topics);
+void update_dictionary(TopicRoute &route, const std::string &topic, const std::string &payload);
+void train_dictionary(std::string topic, uint64_t generation, std::shared_ptr<DictionaryTrainer> trainer);
+bool acl_allows(Session &session, const TopicRoute &route, const std::string &topic, AclPermission permission);
+void leave_consumer_group(Session &session, TopicRoute &route, const std::string &topic);
+void announce_assignments(const std::string &topic, const ConsumerGroup &group, uint32_t partitions);
+uint32_t partition_for(TopicRoute &route, const std::string &key);
+size_t fan_out(TopicRoute &route, const std::string &topic, const std::string &payload, const PublishMeta &meta, uint64_t trace_id);
+size_t fan_out_union(const std::vector<std::string> &topics, const std::string &payload, uint64_t trace_id);
+void buffer_publish(Session &session, std::vector<std::string> topics, const std::string &payload, const PublishMeta &meta);
+void wait_for_fences(std::unique_lock<std::mutex> &lock, const std::vector<std::string> &topics);
 
 void setup_command_handlers();
-void handle_connect(std::shared_ptr<tcp::socket> socket, const std::string &args);
-void handle_disconnect(std::shared_ptr<tcp::socket> socket, const std::string &);
-void handle_subscribe(std::shared_ptr<tcp::socket> socket, std::string topic);
-void handle_unsubscribe(std::shared_ptr<tcp::socket> socket, std::string topic);
-void handle_publish(std::shared_ptr<tcp::socket> socket, const std::string &args);
+void handle_connect(Session &session, const std::string &args);
+void handle_disconnect(Session &session, const std::string &);
+void release_client_name(Session &session);
+void handle_subscribe(Session &session, const std::string &args);
+void handle_unsubscribe(Session &session, std::string topic);
+void handle_publish(Session &session, const std::string &args);
+void handle_alias_publish(Session &session, const std::string &args);
+void publish_message(Session &session, const std::string &topic, const std::string &payload, const PublishMeta &meta = {});
+uint64_t begin_trace(const PublishMeta &meta);
+void handle_mpublish(Session &session, const std::string &args);
+void handle_kpublish(Session &session, const std::string &args);
+void handle_hpublish(Session &session, const std::string &args);
+void handle_partitions(Session &session, const std::string &args);
+void handle_begin(Session &session, const std::string &);
+void handle_commit(Session &session, const std::string &);
+void handle_abort(Session &session, const std::string &);
+void handle_credit(Session &session, const std::string &args);
+void handle_top(Session &session, const std::string &args);
+void handle_trace(Session &session, const std::string &args);
+void handle_interest(Session &session, const std::string &args);
+void handle_alias(Session &session, const std::string &args);
+void handle_enable(Session &session, const std::string &args);
+void handle_delta(Session &session, const std::string &args);
+void handle_resync(Session &session, const std::string &args);
+void handle_compress(Session &session, const std::string &args);
+void handle_derive(Session &session, const std::string &args);
+void handle_archive(Session &session, const std::string &args);
+void handle_compact(Session &session, const std::string &args);
+void handle_get(Session &session, const std::string &args);
+void update_state(StateTable &state, const std::string &key, const std::string &payload);
+bool server_consumed(const TopicRoute &route);
+void remove_derived(const std::string &name);
+void feed_derived(TopicRoute &route, const std::string &payload);
+void publish_derived(std::weak_ptr<DerivedTopic> weak_derived);
+bool parse_number(const std::string &payload, double &value);
+bool parse_replay_time(const std::string &text, uint64_t &timestamp_ms);
+size_t send_replay(Session &session, const std::string &topic, ArchiveCursor &cursor, uint64_t end_offset);
 
-void send_message(std::shared_ptr<tcp::socket> socket, const std::string &message);
+void send_message(Session &session, const std::string &message);
+void write_socket(Session &session, const std::string &data, boost::system::error_code &error);
+size_t read_socket(Session &session, char *data, size_t size, boost::system::error_code &error);
+bool send_frame(Session &session, SessionHandle handle, const Frame &frame);
+bool deliver_frame(SessionHandle handle, const Frame &frame);
+bool deliver_sampled(const Subscriber &subscriber, const Frame &frame);
+void flush_conflated(SessionHandle handle, std::weak_ptr<Downsampler> weak_sampling);
+void drain_backlog(Session &session);
 
 std::string sanitize_topic(const std::string &topic);
 std::string sanitize_message(const std::string &message);
-ClientMetadata get_client_metadata(std::shared_ptr<tcp::socket> socket);
+ClientMetadata get_client_metadata(Session &session);
+std::string get_client_key(Session &session);
 void log_action(const std::string &action, const ClientMetadata &client, const std::string &details);
 
 /**
@@ -73,6 +599,78 @@ int main(int argc, char *argv[])
         .scan<'i', int>()
         .help("Port number to listen on");
 
+    program.add_argument("--slow-consumer")
+        .default_value(std::string("drop-oldest"))
+        .help("Policy when a credit based subscriber overflows its backlog: drop-oldest, drop-newest or disconnect");
+
+    program.add_argument("--max-backlog")
+        .default_value(1024)
+        .scan<'i', int>()
+        .help("Frames buffered per credit based subscriber before the slow consumer policy applies");
+
+    program.add_argument("--trace-sample")
+        .default_value(0)
+        .scan<'i', int>()
+        .help("Trace one in N published messages, 0 disables tracing");
+
+    program.add_argument("--trace-file")
+        .default_value(std::string("trace.json"))
+        .help("File the TRACE command exports Chrome trace-event JSON to");
+
+    program.add_argument("--max-sessions")
+        .default_value(65536)
+        .scan<'i', int>()
+        .help("Maximum number of concurrent client sessions");
+
+    program.add_argument("--max-topics")
+        .default_value(65536)
+        .scan<'i', int>()
+        .help("Maximum number of topics clients can create, routes and aliases are kept for the server lifetime");
+
+    program.add_argument("--http-port")
+        .default_value(0)
+        .scan<'i', int>()
+        .help("Port accepting WebSocket upgrades and event stream requests, 0 disables it");
+
+    program.add_argument("--tls-cert")
+        .default_value(std::string(""))
+        .help("PEM certificate chain, enables TLS on the listening port");
+
+    program.add_argument("--tls-key")
+        .default_value(std::string(""))
+        .help("PEM private key of the TLS certificate");
+
+    program.add_argument("--no-ktls")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Keep TLS record encryption in user space instead of handing it to kernel TLS");
+
+    program.add_argument("--acl")
+        .default_value(std::string(""))
+        .help("ACL file of allow|deny <client> publish|subscribe|all <topic> rules, unmatched permissions are denied");
+
+    program.add_argument("--archive-dir")
+        .default_value(std::string(""))
+        .help("Directory archived topics are appended to, one directory of segment files per topic");
+
+    program.add_argument("--archive-topics")
+        .default_value(std::string(""))
+        .help("Comma separated topics archived from startup, ARCHIVE <topic> ON|OFF changes the selection at runtime");
+
+    program.add_argument("--archive-segment-mb")
+        .default_value(64)
+        .scan<'i', int>()
+        .help("Size in MB after which an archive segment is closed and the next one started");
+
+    program.add_argument("--archive-cold-dir")
+        .default_value(std::string(""))
+        .help("Directory closed archive segments are compressed into once they are older than --archive-cold-after");
+
+    program.add_argument("--archive-cold-after")
+        .default_value(3600)
+        .scan<'i', int>()
+        .help("Seconds since its last write after which a closed archive segment moves to the cold directory");
+
     try
     {
         program.parse_args(argc, argv);
@@ -86,9 +684,96 @@ int main(int argc, char *argv[])
 
     int port = program.get<int>("--listen");
 
+    std::string policy = program.get<std::string>("--slow-consumer");
+    if (policy == "drop-oldest")
+        slow_consumer_policy = SlowConsumerPolicy::DropOldest;
+    else if (policy == "drop-newest")
+        slow_consumer_policy = SlowConsumerPolicy::DropNewest;
+    else if (policy == "disconnect")
+        slow_consumer_policy = SlowConsumerPolicy::Disconnect;
+    else
+    {
+        std::cerr << "Unknown slow consumer policy: " << policy << "\n";
+        return 1;
+    }
+    max_backlog = std::max(1, program.get<int>("--max-backlog"));
+    tracer.set_sample_every(std::max(0, program.get<int>("--trace-sample")));
+    trace_file = program.get<std::string>("--trace-file");
+    max_sessions = std::min<size_t>(std::max(1, program.get<int>("--max-sessions")), SESSION_INDEX_MASK + 1);
+    max_topics = std::max(1, program.get<int>("--max-topics"));
+
+    sessions = std::make_unique<Session[]>(max_sessions);
+    for (size_t i = max_sessions; i > 0; --i)
+    {
+        free_sessions.push_back(static_cast<uint32_t>(i - 1));
+    }
+
+    std::string acl_file = program.get<std::string>("--acl");
+    if (!acl_file.empty())
+    {
+        std::string error;
+        acl_rules = std::make_unique<AclRules>();
+        if (!acl_rules->load(acl_file, error))
+        {
+            std::cerr << "ACL error: " << error << "\n";
+            return 1;
+        }
+    }
+
+    std::string archive_dir = program.get<std::string>("--archive-dir");
+    if (!archive_dir.empty())
+    {
+        std::string error;
+        archive = std::make_unique<Archive>(archive_dir, static_cast<size_t>(std::max(1, program.get<int>("--archive-segment-mb"))) << 20);
+        if (!program.get<std::string>("--archive-cold-dir").empty())
+            archive->set_cold_tier(program.get<std::string>("--archive-cold-dir"), std::chrono::seconds(std::max(0, program.get<int>("--archive-cold-after"))));
+        if (!archive->start(error))
+        {
+            std::cerr << "Archive error: " << error << "\n";
+            return 1;
+        }
+
+        std::istringstream topics(program.get<std::string>("--archive-topics"));
+        std::string topic;
+        while (std::getline(topics, topic, ','))
+        {
+            if (sanitize_topic(topic).empty())
+                continue;
+            archive->open_topic(sanitize_topic(topic));
+            route_for(sanitize_topic(topic)).archived = true;
+        }
+    }
+    else if (!program.get<std::string>("--archive-topics").empty() || !program.get<std::string>("--archive-cold-dir").empty())
+    {
+        std::cerr << "--archive-topics and --archive-cold-dir need --archive-dir\n";
+        return 1;
+    }
+
+    std::string tls_cert = program.get<std::string>("--tls-cert");
+    if (!tls_cert.empty())
+    {
+        try
+        {
+            tls_context = std::make_unique<TlsContext>(tls_cert, program.get<std::string>("--tls-key"), !program.get<bool>("--no-ktls"));
+        }
+        catch (const std::runtime_error &err)
+        {
+            std::cerr << err.what() << "\n";
+            return 1;
+        }
+        // OpenSSL writes user space records without MSG_NOSIGNAL
+        std::signal(SIGPIPE, SIG_IGN);
+    }
+
     try
     {
         setup_command_handlers();
+        timer_wheel.start();
+
+        int http_port = program.get<int>("--http-port");
+        if (http_port > 0)
+            std::thread(start_http_server, http_port).detach();
+
         boost::asio::io_context io_context;
         start_server(io_context, port);
     }
@@ -97,324 +782,3258 @@ int main(int argc, char *argv[])
         std::cerr << "Server error: " << e.what() << std::endl;
     }
 
-    return 0;
+    return 0;
+}
+
+/**
+ * @brief Start the server on a port
+ *
+ * @param io_context The io_context class provides the core I/O functionality
+ * for users of the asynchronous I/O objects
+ * @param port Server listening port
+ */
+void start_server(boost::asio::io_context &io_context, int port)
+{
+    tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), port));
+
+    std::cout << "Server started on port " << port << (tls_context ? " (TLS)" : "") << std::endl;
+
+    while (true)
+    {
+        auto socket = std::make_shared<tcp::socket>(io_context);
+        acceptor.accept(*socket);
+        std::thread(client_handler, socket).detach();
+    }
+}
+
+/**
+ * @brief Starts the HTTP listener for WebSocket and event stream clients
+ *
+ * @param port HTTP listening port
+ */
+void start_http_server(int port)
+{
+    try
+    {
+        tcp::acceptor acceptor(http_io_context, tcp::endpoint(tcp::v4(), port));
+
+        std::cout << "HTTP listener started on port " << port << std::endl;
+
+        std::thread([]()
+                    {
+                        auto work = boost::asio::make_work_guard(http_io_context);
+                        http_io_context.run(); })
+            .detach();
+
+        while (true)
+        {
+            auto socket = std::make_shared<tcp::socket>(http_io_context);
+            acceptor.accept(*socket);
+            std::thread(http_client_handler, socket).detach();
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "HTTP listener error: " << e.what() << std::endl;
+    }
+}
+
+/**
+ * @brief Handles an HTTP connection, WebSocket upgrades become sessions sharing the command handlers
+ * and GET /topics/<name>/stream becomes a read-only event stream of the topic
+ *
+ * @param socket TCP Socket
+ */
+void http_client_handler(std::shared_ptr<tcp::socket> socket)
+{
+    HttpRequest request;
+    std::string leftover;
+    boost::system::error_code ignored;
+    if (!read_http_request(*socket, request, leftover))
+        return;
+
+    const std::string prefix = "/topics/", suffix = "/stream";
+    if (request.method == "GET" && request.path.size() > prefix.size() + suffix.size() &&
+        request.path.compare(0, prefix.size(), prefix) == 0 &&
+        request.path.compare(request.path.size() - suffix.size(), suffix.size(), suffix) == 0)
+    {
+        start_event_stream(socket, request.path.substr(prefix.size(), request.path.size() - prefix.size() - suffix.size()));
+        return;
+    }
+
+    if (!is_websocket_upgrade(request))
+    {
+        boost::asio::write(*socket, boost::asio::buffer(std::string("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n")), ignored);
+        return;
+    }
+
+    Session *session = acquire_session(socket, FeatureWebSocket);
+    if (!session)
+    {
+        boost::asio::write(*socket, boost::asio::buffer(std::string("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n")), ignored);
+        return;
+    }
+
+    try
+    {
+        {
+            std::lock_guard<std::mutex> lock(session->write_mutex);
+            boost::asio::write(*socket, boost::asio::buffer(websocket_handshake_response(request)));
+        }
+        websocket_handler(*session, leftover);
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "WebSocket client error: " << e.what() << std::endl;
+    }
+
+    release_session(*session);
+}
+
+/**
+ * @brief Reads WebSocket messages, every line of a text or binary message is one command
+ *
+ * @param session WebSocket session
+ * @param leftover Bytes the client sent right after the upgrade request
+ */
+void websocket_handler(Session &session, const std::string &leftover)
+{
+    WebSocketReader reader(MAX_COMMAND_LENGTH);
+    reader.feed(leftover.data(), leftover.size());
+
+    char data[1024];
+    while (true)
+    {
+        WebSocketOpcode opcode;
+        std::string payload;
+        while (reader.next(opcode, payload))
+        {
+            switch (opcode)
+            {
+            case WebSocketOpcode::Ping:
+                send_websocket_control(session, payload, WebSocketOpcode::Pong);
+                break;
+            case WebSocketOpcode::Close:
+                send_websocket_control(session, payload.substr(0, 2), WebSocketOpcode::Close);
+                return;
+            case WebSocketOpcode::Text:
+            case WebSocketOpcode::Binary:
+            {
+                std::istringstream lines(payload);
+                std::string message;
+                while (std::getline(lines, message))
+                {
+                    if (!message.empty() && message.back() == '\r')
+                        message.pop_back();
+                    if (!message.empty())
+                        dispatch_command(session, message);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
+        if (reader.failed())
+        {
+            // 1002 protocol error, covers unmasked and oversized frames
+            send_websocket_control(session, std::string("\x03\xEA", 2), WebSocketOpcode::Close);
+            return;
+        }
+
+        boost::system::error_code error;
+        size_t length = session.socket->read_some(boost::asio::buffer(data), error);
+        if (error == boost::asio::error::eof)
+        {
+            ClientMetadata client = get_client_metadata(session);
+            log_action("DISCONNECT", client, error.message());
+            return;
+        }
+        else if (error)
+        {
+            throw boost::system::system_error(error);
+        }
+
+        if (tracer.enabled())
+            read_timestamp = Tracer::now_ns();
+
+        reader.feed(data, length);
+    }
+}
+
+/**
+ * @brief Subscribes an event stream session to a topic and hands its socket over to the read watch
+ * The handler thread ends here, an idle stream only costs its session slot and a pending read
+ *
+ * @param socket TCP Socket
+ * @param name Topic name from the request path
+ */
+void start_event_stream(std::shared_ptr<tcp::socket> socket, const std::string &name)
+{
+    boost::system::error_code ignored;
+    std::string topic = sanitize_topic(name);
+    if (topic.empty())
+    {
+        boost::asio::write(*socket, boost::asio::buffer(std::string("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n")), ignored);
+        return;
+    }
+
+    Session *session = acquire_session(socket, FeatureEventStream);
+    if (!session)
+    {
+        boost::asio::write(*socket, boost::asio::buffer(std::string("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n")), ignored);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(session->write_mutex);
+        boost::asio::write(*socket, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\n"
+                                                                    "Content-Type: text/event-stream\r\n"
+                                                                    "Cache-Control: no-cache\r\n"
+                                                                    "Connection: keep-alive\r\n\r\n")),
+                           ignored);
+    }
+    if (ignored)
+    {
+        release_session(*session);
+        return;
+    }
+
+    handle_subscribe(*session, topic);
+    watch_event_stream(*session, session->handle);
+}
+
+/**
+ * @brief Waits for an event stream client to go away, the session is released once the read fails
+ * Event stream clients send nothing after the request, stray bytes are ignored
+ *
+ * @param session Event stream session
+ * @param handle Session handle
+ */
+void watch_event_stream(Session &session, SessionHandle handle)
+{
+    auto buffer = std::make_shared<std::array<char, 64>>();
+    session.socket->async_read_some(boost::asio::buffer(*buffer), [&session, handle, buffer](const boost::system::error_code &error, size_t)
+                                    {
+        if (!is_current(session, handle))
+            return;
+
+        if (!error)
+        {
+            watch_event_stream(session, handle);
+            return;
+        }
+
+        ClientMetadata client = get_client_metadata(session);
+        log_action("DISCONNECT", client, error.message());
+        release_session(session); });
+}
+
+/**
+ * @brief Writes a WebSocket control frame
+ *
+ * @param session WebSocket session
+ * @param payload Control payload
+ * @param opcode Ping, Pong or Close
+ */
+void send_websocket_control(Session &session, const std::string &payload, WebSocketOpcode opcode)
+{
+    std::lock_guard<std::mutex> lock(session.write_mutex);
+    boost::system::error_code ignored;
+    boost::asio::write(*session.socket, boost::asio::buffer(websocket_frame(payload, opcode)), ignored);
+}
+
+/**
+ * @brief Handles interactions with the client
+ * The connection owns one session slot for its whole lifetime
+ *
+ * @param socket TCP Socket
+ */
+void client_handler(std::shared_ptr<tcp::socket> socket)
+{
+    std::unique_ptr<TlsConnection> tls;
+    if (tls_context)
+    {
+        std::string error;
+        tls = tls_context->handshake(socket->native_handle(), "", error);
+        if (!tls)
+        {
+            std::cerr << "TLS handshake failed: " << error << std::endl;
+            return;
+        }
+        std::cout << "[TLS] " << tls->description() << std::endl;
+    }
+
+    Session *session = acquire_session(socket);
+    if (!session)
+    {
+        std::string reply = "[SERVER_ERROR] Too many sessions.\n";
+        boost::system::error_code ignored;
+        if (tls)
+            tls->write(reply.data(), reply.size());
+        else
+            boost::asio::write(*socket, boost::asio::buffer(reply), ignored);
+        return;
+    }
+    session->tls = std::move(tls);
+
+    try
+    {
+        char data[1024];
+        std::string pending;
+
+        while (true)
+        {
+            boost::system::error_code error;
+            size_t length = read_socket(*session, data, sizeof(data), error);
+
+            if (error == boost::asio::error::eof)
+            {
+                ClientMetadata clinet = get_client_metadata(*session);
+                log_action("DISCONNECT", clinet, error.message());
+                break;
+            }
+            else if (error)
+            {
+                throw boost::system::system_error(error);
+            }
+
+            if (tracer.enabled())
+                read_timestamp = Tracer::now_ns();
+
+            // Commands are newline delimited, a single read may carry several of them or a partial one
+            pending.append(data, length);
+
+            size_t newline;
+            while ((newline = pending.find('\n')) != std::string::npos)
+            {
+                std::string message = pending.substr(0, newline);
+                pending.erase(0, newline + 1);
+                if (!message.empty() && message.back() == '\r')
+                    message.pop_back();
+
+                dispatch_command(*session, message);
+            }
+
+            if (pending.size() > MAX_COMMAND_LENGTH)
+            {
+                pending.clear();
+                send_message(*session, "[SERVER_ERROR] Command too long.");
+            }
+        }
+    }
+    catch (std::exception &e)
+    {
+        std::cerr << "Client error: " << e.what() << std::endl;
+    }
+
+    release_session(*session);
+}
+
+/**
+ * @brief Splits a single command line and runs its handler
+ *
+ * @param session Client session
+ * @param message Command line without the trailing newline
+ */
+void dispatch_command(Session &session, const std::string &message)
+{
+    std::cout << "[received] '" << message << "'" << std::endl;
+
+    size_t space1 = message.find(' ');
+    std::string command = (space1 == std::string::npos) ? message : message.substr(0, space1);
+    std::string args = (space1 == std::string::npos) ? "" : message.substr(space1 + 1);
+
+    auto it = command_handlers.find(command);
+    if (it != command_handlers.end())
+    {
+        it->second(session, args);
+    }
+    else
+    {
+        send_message(session, "[SERVER_ERROR] Unknown command: " + command);
+    }
+}
+
+/**
+ * @brief Initialize command handlers
+ *
+ */
+void setup_command_handlers()
+{
+    command_handlers["CONNECT"] = handle_connect;
+    command_handlers["DISCONNECT"] = handle_disconnect;
+    command_handlers["SUBSCRIBE"] = handle_subscribe;
+    command_handlers["UNSUBSCRIBE"] = handle_unsubscribe;
+    command_handlers["PUBLISH"] = handle_publish;
+    command_handlers["MPUBLISH"] = handle_mpublish;
+    command_handlers["CREDIT"] = handle_credit;
+    command_handlers["TOP"] = handle_top;
+    command_handlers["TRACE"] = handle_trace;
+    command_handlers["INTEREST"] = handle_interest;
+    command_handlers["ALIAS"] = handle_alias;
+    command_handlers["P"] = handle_alias_publish;
+    command_handlers["ENABLE"] = handle_enable;
+    command_handlers["DELTA"] = handle_delta;
+    command_handlers["RESYNC"] = handle_resync;
+    command_handlers["COMPRESS"] = handle_compress;
+    command_handlers["KPUBLISH"] = handle_kpublish;
+    command_handlers["HPUBLISH"] = handle_hpublish;
+    command_handlers["PARTITIONS"] = handle_partitions;
+    command_handlers["BEGIN"] = handle_begin;
+    command_handlers["COMMIT"] = handle_commit;
+    command_handlers["ABORT"] = handle_abort;
+    command_handlers["DERIVE"] = handle_derive;
+    command_handlers["ARCHIVE"] = handle_archive;
+    command_handlers["COMPACT"] = handle_compact;
+    command_handlers["GET"] = handle_get;
+}
+
+/**
+ * @brief Connect command Handler
+ *
+ * @param session Client session
+ * @param args Client connection parameters
+ */
+void handle_connect(Session &session, const std::string &args)
+{
+    std::lock_guard<std::mutex> lock(client_mutex);
+
+    std::istringstream iss(args);
+    int client_port;
+    std::string client_name;
+    int client_pid;
+
+    // Ensure correct parsing of: CONNECT <serverPort> <clientName> <PID>
+    if (!(iss >> client_port >> client_name >> client_pid))
+    {
+        ClientMetadata client = get_client_metadata(session);
+        log_action("CONNECTION_ERROR", client, "Client connect message is malformed.");
+        return;
+    }
+
+    // Rules apply to the requested name, not the unique one. Subscriptions made before are held
+    // to the new rules, the ones they deny are dropped.
+    if (acl_rules)
+    {
+        std::vector<std::string> denied;
+        {
+            std::lock_guard<std::mutex> topic_lock(topic_mutex);
+            {
+                std::lock_guard<std::mutex> acl_lock(session.acl_mutex);
+                session.acl.reset(acl_rules->rules_for(client_name));
+            }
+            for (const auto &topic : session.topics)
+            {
+                auto it = topic_subscribers.find(topic);
+                if (it != topic_subscribers.end() && !acl_allows(session, it->second, topic, AclSubscribe))
+                    denied.push_back(topic);
+            }
+        }
+        for (const auto &topic : denied)
+            handle_unsubscribe(session, topic);
+    }
+
+    // Ensure unique client name (append `-PID` if duplicate, then a counter for pooled connections of one process)
+    if (session.connected)
+        release_client_name(session);
+    if (client_names.count(client_name))
+    {
+        std::string base = client_name + "-" + std::to_string(client_pid);
+        client_name = base;
+        for (int suffix = 2; client_names.count(client_name); ++suffix)
+            client_name = base + "-" + std::to_string(suffix);
+    }
+
+    // Store client info
+    session.connected = true;
+    session.name = client_name;
+    session.pid = client_pid;
+    client_names[client_name] = session.handle;
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("CONNECT", client, "success");
+
+    send_message(session, "[SERVER] Connected as " + client_name);
+}
+
+/**
+ * @brief Frees the name of a session, client_mutex must be held
+ * A name is only erased while it still belongs to the session
+ *
+ * @param session Client session
+ */
+void release_client_name(Session &session)
+{
+    auto owner = client_names.find(session.name);
+    if (owner != client_names.end() && owner->second == session.handle)
+        client_names.erase(owner);
+}
+
+/**
+ * @brief Disconnect command Handler
+ * Disconnects a client form the server
+ *
+ * @param session Client session
+ */
+void handle_disconnect(Session &session, const std::string &)
+{
+    std::lock_guard<std::mutex> lock(client_mutex);
+
+    if (session.connected)
+    {
+        ClientMetadata client = get_client_metadata(session);
+
+        // Remove client from all topics
+        {
+            std::lock_guard<std::mutex> topic_lock(topic_mutex);
+            unsubscribe_all(session);
+        }
+
+        {
+            std::lock_guard<std::mutex> flow_lock(session.flow_mutex);
+            session.flow_enabled = false;
+            session.flow = FlowControl();
+        }
+
+        log_action("DISCONNECT", client, "success");
+
+        release_client_name(session);
+        session.connected = false;
+        send_message(session, "[SERVER] Disconnected");
+    }
+}
+
+/**
+ * @brief Subscribe command Handler
+ * Subscribes a client to a topic and and if topic is non existant creates a new one.
+ * RATE limits delivery to the latest message every interval, SAMPLE forwards one in N messages.
+ * FROM first replays the archived messages of the topic since a point in time.
+ *
+ * @param session Client session
+ * @param args Topic name and optional RATE <ms> / SAMPLE <n> / FROM <time> options
+ */
+void handle_subscribe(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic;
+    iss >> topic;
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    long interval_ms = 0;
+    long sample_every = 1;
+    std::string consumer_group;
+    bool replaying = false;
+    uint64_t replay_from = 0;
+    std::string option, text;
+    while (iss >> option)
+    {
+        long value = 0;
+        bool valid;
+        if (option == "GROUP")
+            valid = (iss >> consumer_group) && !(consumer_group = sanitize_topic(consumer_group)).empty();
+        else if (option == "FROM")
+            valid = replaying = (iss >> text) && parse_replay_time(text, replay_from);
+        else
+            valid = (option == "RATE" || option == "SAMPLE") && (iss >> value) && value >= 1;
+        if (!valid)
+        {
+            send_message(session, "[SERVER_ERROR] Invalid subscribe options! Use: SUBSCRIBE <topic> [RATE <ms>] [SAMPLE <n>] [FROM <time>] or SUBSCRIBE <topic> GROUP <name>");
+            return;
+        }
+        if (option == "RATE")
+            interval_ms = value;
+        else if (option == "SAMPLE")
+            sample_every = value;
+    }
+
+    // A consumer group member gets the messages of its partitions only, sampling them has no meaning
+    if (!consumer_group.empty() && (interval_ms > 0 || sample_every > 1))
+    {
+        send_message(session, "[SERVER_ERROR] GROUP cannot be combined with RATE or SAMPLE");
+        return;
+    }
+
+    // History is replayed to a whole topic subscription, a group member only owns some partitions
+    if (replaying && !consumer_group.empty())
+    {
+        send_message(session, "[SERVER_ERROR] GROUP cannot be combined with FROM");
+        return;
+    }
+    if (replaying && !archive)
+    {
+        send_message(session, "[SERVER_ERROR] Replay is disabled, start the server with --archive-dir");
+        return;
+    }
+
+    std::shared_ptr<Downsampler> sampling;
+    if (interval_ms > 0 || sample_every > 1)
+    {
+        sampling = std::make_shared<Downsampler>();
+        sampling->interval = std::chrono::milliseconds(interval_ms);
+        sampling->sample_every = static_cast<uint32_t>(sample_every);
+    }
+
+    ArchiveCursor cursor{replay_from};
+    size_t replayed = 0;
+    if (replaying)
+    {
+        {
+            std::lock_guard<std::mutex> lock(topic_mutex);
+            if (!can_route(session, {topic}))
+                return;
+            if (!acl_allows(session, route_for(topic), topic, AclSubscribe))
+            {
+                send_message(session, "[SERVER_ERROR] Not allowed to subscribe to topic: " + topic);
+                return;
+            }
+            if (session.topics.count(topic))
+            {
+                send_message(session, "[SERVER_ERROR] Already subscribed to " + topic + ", UNSUBSCRIBE before replaying it");
+                return;
+            }
+        }
+
+        // The bulk of the history is sent without holding up routing, up to the records already on disk
+        archive->open_topic(topic);
+        replayed = send_replay(session, topic, cursor, archive->durable_offset(topic));
+    }
+
+    std::unique_lock<std::mutex> lock(topic_mutex);
+    wait_for_fences(lock, {topic});
+
+    if (!can_route(session, {topic}))
+        return;
+    auto &route = route_for(topic);
+    uint64_t cut = 0;
+    if (!acl_allows(session, route, topic, AclSubscribe))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to subscribe to topic: " + topic);
+        return;
+    }
+    auto &sampled = route.sampled;
+
+    auto it = std::find_if(sampled.begin(), sampled.end(),
+                           [&](const Subscriber &s)
+                           { return s.session == session.handle; });
+
+    auto consumer = session.consumer_groups.find(topic);
+    if (!session.topics.count(topic)) // Only add if not already subscribed
+    {
+        if (replaying)
+        {
+            // Messages from the cut on are routed to the subscription, the replay covers the ones before it.
+            // Live frames wait in the backlog until the replay is sent.
+            cut = archive->next_offset(topic);
+            std::lock_guard<std::mutex> flow_lock(session.flow_mutex);
+            session.flow.replaying = true;
+        }
+
+        if (!consumer_group.empty())
+        {
+            auto group = std::find_if(route.consumer_groups.begin(), route.consumer_groups.end(),
+                                      [&](const ConsumerGroup &g)
+                                      { return g.name == consumer_group; });
+            if (group == route.consumer_groups.end())
+                group = route.consumer_groups.insert(route.consumer_groups.end(), ConsumerGroup{consumer_group, {}});
+            group->members.push_back(session.handle);
+            session.consumer_groups[topic] = consumer_group;
+        }
+        else if (sampling)
+            sampled.push_back({session.handle, sampling});
+        else
+            set_full_rate(session, topic, true);
+        session.topics.insert(topic);
+        if (++route.sessions == 1 && !server_consumed(route))
+            notify_interest(topic, true);
+    }
+    else if (consumer != session.consumer_groups.end() || !consumer_group.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Already subscribed to " + topic + ", UNSUBSCRIBE before changing its consumer group");
+        return;
+    }
+    else if (sampling || it != sampled.end())
+    {
+        // Re-subscribing with options replaces the delivery mode of the subscription
+        if (it != sampled.end() && sampling)
+        {
+            it->sampling = sampling;
+        }
+        else if (sampling)
+        {
+            set_full_rate(session, topic, false);
+            sampled.push_back({session.handle, sampling});
+        }
+        else
+        {
+            sampled.erase(it);
+            set_full_rate(session, topic, true);
+        }
+        send_message(session, "[SERVER] Subscription updated for " + topic);
+        return;
+    }
+    else
+    {
+        send_message(session, "[SERVER] Already subscribed to " + topic);
+        return;
+    }
+
+    // Fetch client metadata
+    ClientMetadata client = get_client_metadata(session);
+    log_action("SUBSCRIBE", client, "Topic: " + topic + (sampling ? " (sampled)" : "") + (consumer_group.empty() ? "" : " (group " + consumer_group + ")") +
+                                        (replaying ? " (from " + std::to_string(replay_from) + ")" : ""));
+
+    // The alias and dictionary are announced before the first frame that uses them
+    uint32_t features = session.features.load(std::memory_order_relaxed);
+    std::string announce;
+    if (features & FeatureAliases)
+        announce = "[ALIAS] " + std::to_string(route.alias) + " " + topic + "\n";
+    if (replaying)
+    {
+        if ((features & FeatureCompress) && route.dictionary_frame)
+            deliver_frame(session.handle, route.dictionary_frame);
+        lock.unlock();
+
+        // The rest of the history is read and sent without the routing lock, up to the cut
+        if (archive->durable_offset(topic) < cut && !archive->wait_durable(topic, cut, std::chrono::milliseconds(REPLAY_SYNC_TIMEOUT_MS)))
+            std::cerr << "[ARCHIVE] " << topic << ": replay continues before offset " << cut << " was written" << std::endl;
+        replayed += send_replay(session, topic, cursor, cut);
+        send_message(session, announce + "[SERVER] Replayed " + std::to_string(replayed) + " messages of " + topic + "\n[SERVER] Subscribed to " + topic);
+
+        {
+            std::lock_guard<std::mutex> flow_lock(session.flow_mutex);
+            session.flow.replaying = false;
+        }
+        drain_backlog(session);
+        return;
+    }
+    send_message(session, announce + "[SERVER] Subscribed to " + topic);
+    if ((features & FeatureCompress) && route.dictionary_frame)
+        deliver_frame(session.handle, route.dictionary_frame);
+
+    // Joining moves partitions, every member learns its new share
+    for (const auto &group : route.consumer_groups)
+    {
+        if (group.name == consumer_group)
+            announce_assignments(topic, group, route.partitions);
+    }
+}
+
+/**
+ * @brief Unsubscribe command Handler
+ * Unsubscribes the client form the given topic
+ *
+ * @param session Client session
+ * @param topic Topic name
+ */
+void handle_unsubscribe(Session &session, std::string topic)
+{
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+
+    auto it = topic_subscribers.find(topic);
+    if (it == topic_subscribers.end() || !session.topics.count(topic))
+    {
+        send_message(session, "[SERVER_ERROR] You are not subscribed to " + topic);
+        return;
+    }
+
+    // Remove the subscription of this session from its consumer group, its group or the sampled list
+    auto &sampled = it->second.sampled;
+    auto sub_it = std::remove_if(sampled.begin(), sampled.end(),
+                                 [&](const Subscriber &s)
+                                 { return s.session == session.handle; });
+
+    if (session.consumer_groups.count(topic))
+        leave_consumer_group(session, it->second, topic);
+    else if (sub_it != sampled.end())
+        sampled.erase(sub_it, sampled.end());
+    else
+        set_full_rate(session, topic, false);
+
+    session.topics.erase(topic);
+    session.delta_streams.erase(topic);
+    if (--it->second.sessions == 0 && !server_consumed(it->second))
+        notify_interest(topic, false);
+
+    // Fetch client metadata
+    ClientMetadata client = get_client_metadata(session);
+    log_action("UNSUBSCRIBE", client, topic);
+
+    send_message(session, "[SERVER] Unsubscribed from " + topic);
+}
+
+/**
+ * @brief Publish command Handler
+ * Publishes data to a topic and sends it to all subscribed clients
+ *
+ * @param session Client session
+ * @param args Arguments are topic name and topic payload, all ASCII
+ */
+void handle_publish(Session &session, const std::string &args)
+{
+    size_t space = args.find(' ');
+    if (space == std::string::npos)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid publish format! Topic or message missing.");
+        return;
+    }
+
+    std::string topic = sanitize_topic(args.substr(0, space)); // Sanitize topic
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    std::string payload = sanitize_message(args.substr(space + 1)); // Sanitize message
+    if (payload.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid message. Only Base64 characters (A-Z, a-z, 0-9, +, /, =) and max length of 1024 are allowed.");
+        return;
+    }
+
+    publish_message(session, topic, payload);
+}
+
+/**
+ * @brief Aliased publish command Handler
+ * Publishes data to the topic of an alias obtained with ALIAS <topic>
+ *
+ * @param session Client session
+ * @param args Topic alias and topic payload
+ */
+void handle_alias_publish(Session &session, const std::string &args)
+{
+    size_t space = args.find(' ');
+    uint32_t alias = 0;
+    if (space == std::string::npos || !(std::istringstream(args.substr(0, space)) >> alias))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid publish format! Use: P <alias> <message>");
+        return;
+    }
+
+    std::string topic;
+    {
+        std::lock_guard<std::mutex> lock(topic_mutex);
+        if (alias < alias_topics.size())
+            topic = alias_topics[alias];
+    }
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Unknown topic alias: " + std::to_string(alias));
+        return;
+    }
+
+    std::string payload = sanitize_message(args.substr(space + 1)); // Sanitize message
+    if (payload.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid message. Only Base64 characters (A-Z, a-z, 0-9, +, /, =) and max length of 1024 are allowed.");
+        return;
+    }
+
+    publish_message(session, topic, payload);
+}
+
+/**
+ * @brief Sends a validated message to all subscribers of a topic
+ * Each consumer group gets it once, at the member owning the partition of the key
+ *
+ * @param session Publishing client session
+ * @param topic Sanitized topic name
+ * @param payload Sanitized payload
+ * @param meta Partition key, header block and TTL
+ */
+void publish_message(Session &session, const std::string &topic, const std::string &payload, const PublishMeta &meta)
+{
+    if (session.in_transaction)
+    {
+        buffer_publish(session, {topic}, payload, meta);
+        return;
+    }
+
+    uint64_t trace_id = begin_trace(meta);
+    tracer.record(trace_id, TraceStage::Read, 0, read_timestamp);
+    tracer.record(trace_id, TraceStage::Parse);
+
+    std::string publisher = get_client_key(session);
+    topic_load.messages.add(topic, 1);
+    topic_load.bytes.add(topic, payload.size());
+    client_load.messages.add(publisher, 1);
+    client_load.bytes.add(publisher, payload.size());
+
+    std::unique_lock<std::mutex> lock(topic_mutex);
+    wait_for_fences(lock, {topic});
+    auto it = topic_subscribers.find(topic);
+
+    if (it != topic_subscribers.end() && !acl_allows(session, it->second, topic, AclPublish))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to publish to topic: " + topic);
+        return;
+    }
+
+    if (it == topic_subscribers.end() || (it->second.sessions == 0 && !server_consumed(it->second)))
+    {
+        send_message(session, "[SERVER_ERROR] No subscribers for topic: " + topic);
+        return;
+    }
+
+    tracer.record(trace_id, TraceStage::Route);
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("PUBLISH", client, "Topic: " + topic + " Message: " + payload);
+
+    size_t fanout = fan_out(it->second, topic, payload, meta, trace_id);
+    client_load.fanout.add(publisher, fanout);
+}
+
+/**
+ * @brief Starts the trace of a message, sampled like any other message
+ * A trace id from its header is recorded with the trace, it never replaces the tracer's own id
+ *
+ * @param meta Routing data of the message
+ * @return uint64_t Trace id, 0 when the message is not traced
+ */
+uint64_t begin_trace(const PublishMeta &meta)
+{
+    uint64_t trace_id = tracer.begin();
+    if (meta.trace_id != 0)
+        tracer.record(trace_id, TraceStage::Header, meta.trace_id);
+    return trace_id;
+}
+
+/**
+ * @brief Delivers a message to every subscriber of one topic, topic_mutex must be held
+ * Each consumer group gets it once, at the member owning the partition of the key
+ *
+ * @param route Routing entry of the topic
+ * @param topic Topic name
+ * @param payload Sanitized payload
+ * @param meta Partition key, header block and TTL
+ * @param trace_id Trace id or 0
+ * @return size_t Number of subscribers
+ */
+size_t fan_out(TopicRoute &route, const std::string &topic, const std::string &payload, const PublishMeta &meta, uint64_t trace_id)
+{
+    feed_derived(route, payload);
+    if (route.archived)
+        archive->append(topic, meta.key, payload);
+    if (route.state && !meta.key.empty())
+        update_state(*route.state, meta.key, payload);
+
+    // Each encoding is built once and shared by every subscriber and backlog
+    update_dictionary(route, topic, payload);
+    FrameCache frames(route, topic, payload, meta, trace_id);
+
+    // Failed or stale subscribers are skipped, their session removes them from the topic on release
+    for (const SubscriberGroup *group : route.groups)
+    {
+        for (SessionHandle member : group->members)
+            deliver_frame(member, frames.for_session(member));
+    }
+    for (const auto &subscriber : route.sampled)
+        deliver_sampled(subscriber, frames.for_sampled(subscriber.session));
+
+    if (!route.consumer_groups.empty())
+    {
+        uint32_t partition = partition_for(route, meta.key);
+        for (const auto &group : route.consumer_groups)
+        {
+            SessionHandle owner = group.members[partition % group.members.size()];
+            deliver_frame(owner, frames.for_session(owner));
+        }
+    }
+
+    topic_load.fanout.add(topic, route.sessions);
+    return route.sessions;
+}
+
+/**
+ * @brief Multi-topic publish command Handler
+ * Publishes one payload to several topics, a client subscribed to more than one of them
+ * receives a single frame tagged with the first of its topics in the given order
+ *
+ * @param session Client session
+ * @param args Comma separated topic names and the payload
+ */
+void handle_mpublish(Session &session, const std::string &args)
+{
+    size_t space = args.find(' ');
+    if (space == std::string::npos)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid publish format! Topics or message missing.");
+        return;
+    }
+
+    std::vector<std::string> topics;
+    std::istringstream list(args.substr(0, space));
+    std::string name;
+    while (std::getline(list, name, ','))
+    {
+        std::string topic = sanitize_topic(name);
+        if (topic.empty())
+        {
+            send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+            return;
+        }
+        if (std::find(topics.begin(), topics.end(), topic) == topics.end())
+            topics.push_back(topic);
+    }
+
+    if (topics.empty() || topics.size() > MAX_PUBLISH_TOPICS)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid publish format! Between 1 and " + std::to_string(MAX_PUBLISH_TOPICS) + " topics are allowed.");
+        return;
+    }
+
+    std::string payload = sanitize_message(args.substr(space + 1)); // Sanitize message
+    if (payload.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid message. Only Base64 characters (A-Z, a-z, 0-9, +, /, =) and max length of 1024 are allowed.");
+        return;
+    }
+
+    if (session.in_transaction)
+    {
+        buffer_publish(session, std::move(topics), payload, {});
+        return;
+    }
+
+    uint64_t trace_id = tracer.begin();
+    tracer.record(trace_id, TraceStage::Read, 0, read_timestamp);
+    tracer.record(trace_id, TraceStage::Parse);
+
+    std::string publisher = get_client_key(session);
+    client_load.messages.add(publisher, 1);
+    client_load.bytes.add(publisher, payload.size());
+    for (const auto &topic : topics)
+    {
+        topic_load.messages.add(topic, 1);
+        topic_load.bytes.add(topic, payload.size());
+    }
+
+    std::unique_lock<std::mutex> lock(topic_mutex);
+    wait_for_fences(lock, topics);
+    tracer.record(trace_id, TraceStage::Route);
+
+    for (const auto &topic : topics)
+    {
+        auto it = topic_subscribers.find(topic);
+        if (it != topic_subscribers.end() && !acl_allows(session, it->second, topic, AclPublish))
+        {
+            send_message(session, "[SERVER_ERROR] Not allowed to publish to topic: " + topic);
+            return;
+        }
+    }
+
+    size_t delivered = fan_out_union(topics, payload, trace_id);
+    client_load.fanout.add(publisher, delivered);
+
+    if (delivered == 0)
+    {
+        send_message(session, "[SERVER_ERROR] No subscribers for topics: " + args.substr(0, space));
+        return;
+    }
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("MPUBLISH", client, "Topics: " + args.substr(0, space) + " Message: " + payload + " Subscribers: " + std::to_string(delivered));
+}
+
+/**
+ * @brief Delivers one message to the union of the subscribers of several topics, topic_mutex must be held
+ * A client subscribed to more than one of them receives a single frame tagged with the first of its topics
+ *
+ * @param topics Topic names in delivery order
+ * @param payload Sanitized payload
+ * @param trace_id Trace id or 0
+ * @return size_t Number of sessions delivered to
+ */
+size_t fan_out_union(const std::vector<std::string> &topics, const std::string &payload, uint64_t trace_id)
+{
+    // Union of the subscribers of all topics, each session is delivered once. A session belongs to
+    // one group only, so groups are deduplicated as a whole and only sampled subscriptions per session.
+    std::unordered_set<const SubscriberGroup *> delivered_groups;
+    std::unordered_set<SessionHandle> delivered_sampled;
+    const PublishMeta unkeyed;
+    size_t delivered = 0;
+    for (const auto &topic : topics)
+    {
+        auto it = topic_subscribers.find(topic);
+        if (it == topic_subscribers.end())
+            continue;
+        feed_derived(it->second, payload);
+        if (it->second.archived)
+            archive->append(topic, "", payload);
+
+        // Frames differ only in the topic tag, they are built once per topic that has new subscribers
+        update_dictionary(it->second, topic, payload);
+        FrameCache frames(it->second, topic, payload, unkeyed, trace_id);
+
+        size_t fanout = 0;
+        for (const SubscriberGroup *group : it->second.groups)
+        {
+            if (!delivered_groups.insert(group).second)
+                continue;
+
+            for (SessionHandle member : group->members)
+            {
+                if (!delivered_sampled.empty() && delivered_sampled.count(member))
+                    continue;
+                deliver_frame(member, frames.for_session(member));
+                fanout++;
+            }
+        }
+
+        for (const auto &subscriber : it->second.sampled)
+        {
+            // Routed handles are current while topic_mutex is held, release unsubscribes first
+            const SubscriberGroup *group = sessions[subscriber.session & SESSION_INDEX_MASK].group;
+            if (delivered_groups.count(group) || !delivered_sampled.insert(subscriber.session).second)
+                continue;
+
+            deliver_sampled(subscriber, frames.for_sampled(subscriber.session));
+            fanout++;
+        }
+
+        if (!it->second.consumer_groups.empty())
+        {
+            uint32_t partition = partition_for(it->second, "");
+            for (const auto &consumers : it->second.consumer_groups)
+            {
+                SessionHandle owner = consumers.members[partition % consumers.members.size()];
+                const SubscriberGroup *group = sessions[owner & SESSION_INDEX_MASK].group;
+                if (delivered_groups.count(group) || !delivered_sampled.insert(owner).second)
+                    continue;
+
+                deliver_frame(owner, frames.for_session(owner));
+                fanout++;
+            }
+        }
+
+        topic_load.fanout.add(topic, fanout);
+        delivered += fanout;
+    }
+    return delivered;
+}
+
+/**
+ * @brief Keyed publish command Handler
+ * Publishes data to a topic, consumer groups get it at the member owning the partition of the key
+ *
+ * @param session Client session
+ * @param args Topic name, key and topic payload
+ */
+void handle_kpublish(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic, key, payload;
+    if (!(iss >> topic >> key >> payload))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid publish format! Use: KPUBLISH <topic> <key> <message>");
+        return;
+    }
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    key = sanitize_topic(key);
+    if (key.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid key. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    payload = sanitize_message(payload);
+    if (payload.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid message. Only Base64 characters (A-Z, a-z, 0-9, +, /, =) and max length of 1024 are allowed.");
+        return;
+    }
+
+    PublishMeta meta;
+    meta.key = key;
+    publish_message(session, topic, payload, meta);
+}
+
+/**
+ * @brief Header publish command Handler
+ * Publishes data with a binary header block in front. Only the fixed offsets and the fields of the
+ * header are read, the payload is routed as is: the "key" field partitions, the TTL bounds how long
+ * frames may wait in a backlog and a trace id is attached to the trace of a sampled message.
+ *
+ * @param session Client session
+ * @param args Topic name, Base64 header block and topic payload
+ */
+void handle_hpublish(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic, header, payload;
+    if (!(iss >> topic >> header >> payload))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid publish format! Use: HPUBLISH <topic> <header> <message>");
+        return;
+    }
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    std::string block;
+    MessageHeaderView view;
+    if (!header_from_base64(header, block) || !view.parse(block))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid header. Expected a Base64 header block of at most " + std::to_string(MAX_HEADER_SIZE) + " bytes.");
+        return;
+    }
+
+    payload = sanitize_message(payload);
+    if (payload.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid message. Only Base64 characters (A-Z, a-z, 0-9, +, /, =) and max length of 1024 are allowed.");
+        return;
+    }
+
+    // The key is written into replays and GET replies, it follows the rules of a KPUBLISH key
+    PublishMeta meta;
+    if (view.find("key", meta.key))
+    {
+        meta.key = sanitize_topic(meta.key);
+        if (meta.key.empty())
+        {
+            send_message(session, "[SERVER_ERROR] Invalid key. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+            return;
+        }
+    }
+    meta.header = std::move(header);
+    meta.ttl_ms = view.ttl_ms();
+    meta.trace_id = view.trace_id();
+    publish_message(session, topic, payload, meta);
+}
+
+/**
+ * @brief Partitions command Handler
+ * Sets the number of key partitions of a topic and rebalances its consumer groups
+ *
+ * @param session Client session
+ * @param args Topic name and number of partitions
+ */
+void handle_partitions(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic;
+    long partitions = 0;
+    if (!(iss >> topic >> partitions) || partitions < 1 || partitions > MAX_PARTITIONS)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid partitions format! Use: PARTITIONS <topic> <1-" + std::to_string(MAX_PARTITIONS) + ">");
+        return;
+    }
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    if (!can_route(session, {topic}))
+        return;
+    TopicRoute &route = route_for(topic);
+    if (!acl_allows(session, route, topic, AclPublish))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to partition topic: " + topic);
+        return;
+    }
+    route.partitions = static_cast<uint32_t>(partitions);
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("PARTITIONS", client, "Topic: " + topic + " Partitions: " + std::to_string(partitions));
+    send_message(session, "[SERVER] Topic " + topic + " has " + std::to_string(partitions) + " partitions");
+
+    for (const auto &group : route.consumer_groups)
+        announce_assignments(topic, group, route.partitions);
+}
+
+/**
+ * @brief Buffers a publish of an open transaction
+ * A publish past the limit fails the transaction, COMMIT then delivers none of it
+ *
+ * @param session Client session
+ * @param topics Validated topic names
+ * @param payload Sanitized payload
+ * @param meta Partition key, header block and TTL
+ */
+void buffer_publish(Session &session, std::vector<std::string> topics, const std::string &payload, const PublishMeta &meta)
+{
+    if (session.transaction_failed)
+        return;
+
+    if (session.transaction.size() >= MAX_TRANSACTION_MESSAGES)
+    {
+        send_message(session, "[SERVER_ERROR] Transaction is full, at most " + std::to_string(MAX_TRANSACTION_MESSAGES) + " messages are allowed. COMMIT will be rejected, use ABORT.");
+        session.transaction_failed = true;
+        session.transaction.clear();
+        return;
+    }
+    session.transaction.push_back({std::move(topics), payload, meta});
+}
+
+/**
+ * @brief Waits until no transaction is being committed to any of the topics, topic_mutex must be held
+ *
+ * @param lock Lock of topic_mutex, released while waiting
+ * @param topics Topic names
+ */
+void wait_for_fences(std::unique_lock<std::mutex> &lock, const std::vector<std::string> &topics)
+{
+    fences_lifted.wait(lock, [&]
+                       { return fenced_topics.empty() || std::none_of(topics.begin(), topics.end(), [](const std::string &topic)
+                                                                      { return fenced_topics.count(topic) > 0; }); });
+}
+
+/**
+ * @brief Begin command Handler
+ * Buffers the following publishes until COMMIT or ABORT
+ *
+ * @param session Client session
+ */
+void handle_begin(Session &session, const std::string &)
+{
+    if (session.in_transaction)
+    {
+        send_message(session, "[SERVER_ERROR] Transaction already open");
+        return;
+    }
+
+    session.in_transaction = true;
+    session.transaction_failed = false;
+    session.transaction.clear();
+    send_message(session, "[SERVER] Transaction started");
+}
+
+/**
+ * @brief Commit command Handler
+ * Fences the topics of the transaction, then delivers the buffered publishes in batches of COMMIT_BATCH_MESSAGES,
+ * releasing topic_mutex in between. Publishes and subscriptions to fenced topics wait for the fence,
+ * so no other message on these topics is seen between or inside the buffered ones, while other topics keep routing.
+ * A publish the ACL denies aborts the whole transaction.
+ *
+ * @param session Client session
+ */
+void handle_commit(Session &session, const std::string &)
+{
+    if (!session.in_transaction)
+    {
+        send_message(session, "[SERVER_ERROR] No open transaction");
+        return;
+    }
+
+    std::vector<PendingPublish> pending;
+    pending.swap(session.transaction);
+    session.in_transaction = false;
+    if (session.transaction_failed)
+    {
+        session.transaction_failed = false;
+        send_message(session, "[SERVER_ERROR] Transaction exceeded " + std::to_string(MAX_TRANSACTION_MESSAGES) + " messages, nothing was committed");
+        return;
+    }
+
+    std::vector<std::string> topics;
+    for (const auto &publish : pending)
+        topics.insert(topics.end(), publish.topics.begin(), publish.topics.end());
+    std::sort(topics.begin(), topics.end());
+    topics.erase(std::unique(topics.begin(), topics.end()), topics.end());
+
+    std::string publisher = get_client_key(session);
+    std::vector<uint64_t> trace_ids;
+    for (const auto &publish : pending)
+    {
+        trace_ids.push_back(begin_trace(publish.meta));
+        tracer.record(trace_ids.back(), TraceStage::Read, 0, read_timestamp);
+        client_load.messages.add(publisher, 1);
+        client_load.bytes.add(publisher, publish.payload.size());
+        for (const auto &topic : publish.topics)
+        {
+            topic_load.messages.add(topic, 1);
+            topic_load.bytes.add(topic, publish.payload.size());
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(topic_mutex);
+    wait_for_fences(lock, topics);
+    for (const auto &topic : topics)
+    {
+        auto it = topic_subscribers.find(topic);
+        if (it != topic_subscribers.end() && !acl_allows(session, it->second, topic, AclPublish))
+        {
+            send_message(session, "[SERVER_ERROR] Not allowed to publish to topic: " + topic + ", transaction aborted");
+            return;
+        }
+    }
+    fenced_topics.insert(topics.begin(), topics.end());
+
+    size_t delivered = 0;
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        // Bounds the time other topics wait for the routing lock, the fences keep the batch together
+        if (i > 0 && i % COMMIT_BATCH_MESSAGES == 0)
+        {
+            lock.unlock();
+            lock.lock();
+        }
+
+        const PendingPublish &publish = pending[i];
+        tracer.record(trace_ids[i], TraceStage::Route);
+        if (publish.topics.size() > 1)
+        {
+            delivered += fan_out_union(publish.topics, publish.payload, trace_ids[i]);
+            continue;
+        }
+
+        auto it = topic_subscribers.find(publish.topics.front());
+        if (it != topic_subscribers.end() && (it->second.sessions > 0 || server_consumed(it->second)))
+            delivered += fan_out(it->second, publish.topics.front(), publish.payload, publish.meta, trace_ids[i]);
+    }
+    for (const auto &topic : topics)
+        fenced_topics.erase(topic);
+    fences_lifted.notify_all();
+    client_load.fanout.add(publisher, delivered);
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("COMMIT", client, "Messages: " + std::to_string(pending.size()) + " Subscribers: " + std::to_string(delivered));
+    send_message(session, "[SERVER] Committed " + std::to_string(pending.size()) + " messages");
+}
+
+/**
+ * @brief Abort command Handler
+ * Discards the buffered publishes of the open transaction
+ *
+ * @param session Client session
+ */
+void handle_abort(Session &session, const std::string &)
+{
+    if (!session.in_transaction)
+    {
+        send_message(session, "[SERVER_ERROR] No open transaction");
+        return;
+    }
+
+    size_t discarded = session.transaction.size();
+    session.in_transaction = false;
+    session.transaction_failed = false;
+    session.transaction.clear();
+    send_message(session, "[SERVER] Transaction aborted, " + std::to_string(discarded) + " messages discarded");
+}
+
+/**
+ * @brief Credit command Handler
+ * Grants message credit and optional byte credit, the first grant enables flow control for the client
+ *
+ * @param session Client session
+ * @param args Number of messages and optional number of bytes
+ */
+void handle_credit(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+
+    if (!(iss >> messages))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid credit format! Use: CREDIT <messages> [bytes]");
+        return;
+    }
+    bool byte_limited = static_cast<bool>(iss >> bytes);
+
+    {
+        std::lock_guard<std::mutex> lock(session.flow_mutex);
+        session.flow_enabled = true;
+        session.flow.message_credit += messages;
+        if (byte_limited)
+        {
+            session.flow.byte_limited = true;
+            session.flow.byte_credit += bytes;
+        }
+    }
+
+    drain_backlog(session);
+}
+
+/**
+ * @brief Top command Handler
+ * Lists the heaviest topics or publishing clients over the recent sliding windows
+ *
+ * @param session Client session
+ * @param args topics|clients [messages|bytes|fanout] [count] [seconds]
+ */
+void handle_top(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string dimension;
+    std::string metric = "messages";
+    size_t count = 10;
+    long seconds = LOAD_WINDOW_SECONDS * LOAD_WINDOWS;
+
+    iss >> dimension;
+    if (!iss.eof())
+        iss >> metric;
+    if (!iss.eof())
+        iss >> count;
+    if (!iss.eof())
+        iss >> seconds;
+
+    LoadTracker *tracker = dimension == "topics" ? &topic_load : dimension == "clients" ? &client_load : nullptr;
+    HeavyHitters *hitters = nullptr;
+    if (tracker)
+        hitters = metric == "messages" ? &tracker->messages : metric == "bytes" ? &tracker->bytes : metric == "fanout" ? &tracker->fanout : nullptr;
+
+    if (!hitters || iss.fail() || count == 0 || seconds < 1)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid top format! Use: TOP <topics|clients> [messages|bytes|fanout] [count] [seconds]");
+        return;
+    }
+
+    auto top = hitters->top(count, std::chrono::seconds(seconds));
+    std::ostringstream oss;
+    oss << "[TOP] " << dimension << " by " << metric << " over " << std::min(seconds, (long)hitters->history_length().count()) << "s";
+    for (size_t i = 0; i < top.size(); ++i)
+    {
+        oss << "\n[TOP] " << (i + 1) << ". " << top[i].first << " " << top[i].second;
+    }
+    send_message(session, oss.str());
+}
+
+/**
+ * @brief Trace command Handler
+ * Without arguments exports the trace buffer to the trace file, SAMPLE <n> changes the sampling rate
+ *
+ * @param session Client session
+ * @param args Empty or SAMPLE <n>
+ */
+void handle_trace(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string option;
+    long every = 0;
+
+    if (!(iss >> option))
+    {
+        std::ofstream out(trace_file);
+        if (!out)
+        {
+            send_message(session, "[SERVER_ERROR] Cannot write trace file " + trace_file);
+            return;
+        }
+        size_t traces = tracer.export_chrome_json(out);
+        send_message(session, "[SERVER] Exported " + std::to_string(traces) + " traces to " + trace_file);
+        return;
+    }
+
+    if (option != "SAMPLE" || !(iss >> every) || every < 0)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid trace format! Use: TRACE [SAMPLE <n>]");
+        return;
+    }
+
+    tracer.set_sample_every(static_cast<uint32_t>(every));
+    send_message(session, every ? "[SERVER] Tracing one in " + std::to_string(every) + " messages" : "[SERVER] Tracing disabled");
+}
+
+/**
+ * @brief Allocates a session slot for a new connection
+ *
+ * @param socket TCP Socket
+ * @param transport FeatureWebSocket, FeatureEventStream or 0 for the text protocol
+ * @return Session* Session or nullptr when the table is full
+ */
+Session *acquire_session(std::shared_ptr<tcp::socket> socket, uint32_t transport)
+{
+    std::lock_guard<std::mutex> lock(session_mutex);
+    if (free_sessions.empty())
+        return nullptr;
+
+    uint32_t index = free_sessions.back();
+    free_sessions.pop_back();
+
+    Session &session = sessions[index];
+    session.socket = socket;
+    session.handle = ((session.generation.load() & SESSION_GENERATION_MASK) << SESSION_INDEX_BITS) | index;
+    session.features = transport;
+    session.in_transaction = false;
+    session.transaction_failed = false;
+    session.transaction.clear();
+    if (acl_rules)
+    {
+        std::lock_guard<std::mutex> acl_lock(session.acl_mutex);
+        session.acl.reset(acl_rules->rules_for(""));
+    }
+    return &session;
+}
+
+/**
+ * @brief Returns a session slot once its connection is gone
+ * Subscriptions are removed first, then the generation is bumped so pending handles go stale
+ *
+ * @param session Client session
+ */
+void release_session(Session &session)
+{
+    {
+        std::lock_guard<std::mutex> lock(topic_mutex);
+        unsubscribe_all(session);
+        session.features = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(client_mutex);
+        if (session.connected)
+            release_client_name(session);
+        session.connected = false;
+        session.name.clear();
+        session.pid = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> write_lock(session.write_mutex);
+        std::lock_guard<std::mutex> flow_lock(session.flow_mutex);
+        session.generation.fetch_add(1, std::memory_order_release);
+        session.flow_enabled = false;
+        session.flow = FlowControl();
+        if (session.tls)
+            session.tls->shutdown();
+        session.tls.reset();
+        session.socket.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(session_mutex);
+    free_sessions.push_back(session.handle & SESSION_INDEX_MASK);
+}
+
+/**
+ * @brief Resolves a handle to its session slot
+ * Callers must re-check is_current() under the session lock they take
+ *
+ * @param handle Session handle
+ * @return Session* Session or nullptr if the handle is stale
+ */
+Session *resolve_session(SessionHandle handle)
+{
+    uint32_t index = handle & SESSION_INDEX_MASK;
+    if (index >= max_sessions)
+        return nullptr;
+
+    Session &session = sessions[index];
+    return is_current(session, handle) ? &session : nullptr;
+}
+
+/**
+ * @brief Checks whether a handle still refers to the current owner of a session slot
+ *
+ * @param session Session slot
+ * @param handle Session handle
+ */
+bool is_current(const Session &session, SessionHandle handle)
+{
+    return (session.generation.load(std::memory_order_acquire) & SESSION_GENERATION_MASK) == handle >> SESSION_INDEX_BITS;
+}
+
+/**
+ * @brief Removes a session from every topic it is subscribed to, topic_mutex must be held
+ *
+ * @param session Client session
+ */
+void unsubscribe_all(Session &session)
+{
+    // The closing session must not receive updates about its own subscriptions
+    if (session.interest)
+    {
+        interest_listeners.erase(std::remove(interest_listeners.begin(), interest_listeners.end(), session.handle), interest_listeners.end());
+        session.interest = false;
+    }
+
+    move_to_group(session, {});
+
+    for (const auto &topic : session.topics)
+    {
+        auto it = topic_subscribers.find(topic);
+        if (it == topic_subscribers.end())
+            continue;
+
+        auto &sampled = it->second.sampled;
+        sampled.erase(std::remove_if(sampled.begin(), sampled.end(),
+                                     [&](const Subscriber &s)
+                                     { return s.session == session.handle; }),
+                      sampled.end());
+        if (session.consumer_groups.count(topic))
+            leave_consumer_group(session, it->second, topic);
+        if (--it->second.sessions == 0 && !server_consumed(it->second))
+            notify_interest(topic, false);
+    }
+    session.topics.clear();
+    session.delta_streams.clear();
+    session.consumer_groups.clear();
+}
+
+/**
+ * @brief Removes a session from its consumer group of a topic and rebalances the partitions
+ * over the remaining members, topic_mutex must be held
+ *
+ * @param session Client session
+ * @param route Routing entry of the topic
+ * @param topic Topic name
+ */
+void leave_consumer_group(Session &session, TopicRoute &route, const std::string &topic)
+{
+    auto consumer = session.consumer_groups.find(topic);
+    if (consumer == session.consumer_groups.end())
+        return;
+
+    for (auto group = route.consumer_groups.begin(); group != route.consumer_groups.end(); ++group)
+    {
+        if (group->name != consumer->second)
+            continue;
+
+        group->members.erase(std::remove(group->members.begin(), group->members.end(), session.handle), group->members.end());
+        if (group->members.empty())
+            route.consumer_groups.erase(group);
+        else
+            announce_assignments(topic, *group, route.partitions);
+        break;
+    }
+    session.consumer_groups.erase(consumer);
+}
+
+/**
+ * @brief Sends every member of a consumer group the partitions it owns, topic_mutex must be held
+ * The [ASSIGN] line lists them comma separated, "-" when a member owns none. It is queued behind
+ * the member's messages and never dropped, a dead or slow member holds up nobody.
+ *
+ * @param topic Topic name
+ * @param group Consumer group
+ * @param partitions Number of partitions of the topic
+ */
+void announce_assignments(const std::string &topic, const ConsumerGroup &group, uint32_t partitions)
+{
+    for (size_t i = 0; i < group.members.size(); ++i)
+    {
+        std::string owned;
+        for (size_t partition = i; partition < partitions; partition += group.members.size())
+            owned += (owned.empty() ? "" : ",") + std::to_string(partition);
+
+        Session *member = resolve_session(group.members[i]);
+        if (!member)
+            continue;
+
+        std::string assignment = "[ASSIGN] " + topic + " " + group.name + " " + (owned.empty() ? "-" : owned);
+        FrameData frame{(member->features.load(std::memory_order_relaxed) & FeatureWebSocket) ? websocket_frame(assignment, WebSocketOpcode::Text) : assignment + "\n"};
+        frame.control = true;
+        deliver_frame(group.members[i], std::make_shared<const FrameData>(std::move(frame)));
+    }
+}
+
+/**
+ * @brief Selects the partition of a message, topic_mutex must be held
+ * Keys are hashed with FNV-1a so a key keeps its partition across restarts, unkeyed messages rotate
+ *
+ * @param route Routing entry of the topic
+ * @param key Message key, empty for unkeyed messages
+ * @return uint32_t Partition
+ */
+uint32_t partition_for(TopicRoute &route, const std::string &key)
+{
+    if (key.empty())
+        return static_cast<uint32_t>(route.next_partition++ % route.partitions);
+
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : key)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return static_cast<uint32_t>(hash % route.partitions);
+}
+
+/**
+ * @brief Adds or removes a full rate subscription by moving the session to the group
+ * of its new topic set, topic_mutex must be held
+ *
+ * @param session Client session
+ * @param topic Topic name
+ * @param subscribed Whether the topic joins or leaves the full rate set
+ */
+void set_full_rate(Session &session, const std::string &topic, bool subscribed)
+{
+    std::set<std::string> topics;
+    if (session.group)
+        topics = session.group->topics;
+
+    if (subscribed)
+        topics.insert(topic);
+    else
+        topics.erase(topic);
+
+    move_to_group(session, std::move(topics));
+}
+
+/**
+ * @brief Moves a session to the subscriber group of the given topic set, topic_mutex must be held
+ * Groups are created on first use and removed from their topics once the last member leaves
+ *
+ * @param session Client session
+ * @param topics Full rate topics of the session, empty leaves every group
+ */
+void move_to_group(Session &session, std::set<std::string> topics)
+{
+    if (session.group)
+    {
+        // Swap-remove keeps leaving O(1) for groups of thousands of sessions
+        SubscriberGroup *old = session.group;
+        SessionHandle last = old->members.back();
+        old->members[session.group_slot] = last;
+        sessions[last & SESSION_INDEX_MASK].group_slot = session.group_slot;
+        old->members.pop_back();
+        session.group = nullptr;
+
+        if (old->members.empty())
+        {
+            for (const auto &topic : old->topics)
+            {
+                auto &groups = route_for(topic).groups;
+                groups.erase(std::remove(groups.begin(), groups.end(), old), groups.end());
+            }
+            std::string key = old->key;
+            subscriber_groups.erase(key);
+        }
+    }
+
+    if (topics.empty())
+        return;
+
+    std::string key;
+    for (const auto &topic : topics)
+        key += topic + " ";
+
+    auto &group = subscriber_groups[key];
+    if (!group)
+    {
+        group = std::make_unique<SubscriberGroup>();
+        group->key = key;
+        group->topics = std::move(topics);
+        for (const auto &topic : group->topics)
+            route_for(topic).groups.push_back(group.get());
+    }
+
+    session.group = group.get();
+    session.group_slot = group->members.size();
+    group->members.push_back(session.handle);
+}
+
+/**
+ * @brief Tells registered publishers that a topic gained its first or lost its last subscriber,
+ * topic_mutex must be held
+ *
+ * @param topic Topic name
+ * @param active Whether the topic has subscribers now
+ */
+void notify_interest(const std::string &topic, bool active)
+{
+    if (interest_listeners.empty())
+        return;
+
+    std::string update = "[INTEREST] " + topic + (active ? " 1" : " 0");
+    Frame frame, websocket;
+    for (SessionHandle handle : interest_listeners)
+    {
+        Session *listener = resolve_session(handle);
+        if (!listener)
+            continue;
+
+        if (listener->features.load(std::memory_order_relaxed) & FeatureWebSocket)
+        {
+            if (!websocket)
+                websocket = std::make_shared<const FrameData>(FrameData{websocket_frame(update, WebSocketOpcode::Text)});
+            send_frame(*listener, handle, websocket);
+        }
+        else
+        {
+            if (!frame)
+                frame = std::make_shared<const FrameData>(FrameData{update + "\n"});
+            send_frame(*listener, handle, frame);
+        }
+    }
+}
+
+/**
+ * @brief Interest command Handler
+ * Registers the client for interest updates and sends the topics that currently have subscribers,
+ * OFF unregisters it
+ *
+ * @param session Client session
+ * @param args Empty or OFF
+ */
+void handle_interest(Session &session, const std::string &args)
+{
+    if (!args.empty() && args != "OFF")
+    {
+        send_message(session, "[SERVER_ERROR] Invalid interest format! Use: INTEREST [OFF]");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+
+    if (args == "OFF")
+    {
+        interest_listeners.erase(std::remove(interest_listeners.begin(), interest_listeners.end(), session.handle), interest_listeners.end());
+        session.interest = false;
+        send_message(session, "[SERVER] Interest updates disabled");
+        return;
+    }
+
+    std::ostringstream oss;
+    for (const auto &pair : topic_subscribers)
+    {
+        if (pair.second.sessions > 0 || server_consumed(pair.second))
+            oss << "[INTEREST] " << pair.first << " 1\n";
+    }
+    oss << "[SERVER] Interest updates enabled";
+
+    if (!session.interest)
+    {
+        interest_listeners.push_back(session.handle);
+        session.interest = true;
+    }
+    send_message(session, oss.str());
+}
+
+/**
+ * @brief Alias command Handler
+ * Returns the alias of a topic so the client can publish with P <alias> <message>
+ *
+ * @param session Client session
+ * @param args Topic name
+ */
+void handle_alias(Session &session, const std::string &args)
+{
+    std::string topic = sanitize_topic(args);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    // Only topics the session receives or may publish to get an alias, ALIAS never creates a route
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    auto it = topic_subscribers.find(topic);
+    if (it == topic_subscribers.end() ||
+        (!session.topics.count(topic) &&
+         !((it->second.sessions > 0 || server_consumed(it->second)) && acl_allows(session, it->second, topic, AclPublish))))
+    {
+        send_message(session, "[SERVER_ERROR] No alias for topic: " + topic + ", subscribe to it or publish once it has subscribers");
+        return;
+    }
+    send_message(session, "[ALIAS] " + std::to_string(it->second.alias) + " " + topic);
+}
+
+/**
+ * @brief Enable command Handler
+ * Turns on an optional protocol feature for the session. Enabling aliases announces
+ * the aliases of all current subscriptions before frames switch to the compact form.
+ *
+ * @param session Client session
+ * @param args Feature name
+ */
+void handle_enable(Session &session, const std::string &args)
+{
+    uint32_t feature = 0;
+    if (args == "aliases")
+        feature = FeatureAliases;
+    else if (args == "delta")
+        feature = FeatureDelta;
+    else if (args == "compress")
+        feature = FeatureCompress;
+    else if (args == "headers")
+        feature = FeatureHeaders;
+    else
+    {
+        send_message(session, "[SERVER_ERROR] Unknown feature: " + args + ". Use: ENABLE aliases|delta|compress|headers");
+        return;
+    }
+
+    // Dictionaries are binary and announced inside text replies
+    if (feature == FeatureCompress && (session.features.load(std::memory_order_relaxed) & FeatureWebSocket))
+    {
+        send_message(session, "[SERVER_ERROR] Feature " + args + " is not available over WebSocket");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+
+    std::ostringstream oss;
+    std::vector<Frame> dictionaries;
+    for (const auto &topic : session.topics)
+    {
+        TopicRoute &route = route_for(topic);
+        if (feature == FeatureAliases)
+            oss << "[ALIAS] " << route.alias << " " << topic << "\n";
+        else if (feature == FeatureCompress && route.dictionary_frame)
+            dictionaries.push_back(route.dictionary_frame);
+    }
+    oss << "[SERVER] Enabled " << args;
+
+    send_message(session, oss.str());
+    // Dictionaries use credit like every other [DICT] frame
+    for (const auto &dictionary : dictionaries)
+        deliver_frame(session.handle, dictionary);
+    session.features.fetch_or(feature, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Delta command Handler
+ * Turns delta encoding of a topic on with a keyframe every N versions, or OFF
+ *
+ * @param session Client session
+ * @param args Topic name and keyframe interval or OFF
+ */
+void handle_delta(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic, interval;
+    iss >> topic >> interval;
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    long keyframe_every = 0;
+    if (interval != "OFF" && (!(std::istringstream(interval) >> keyframe_every) || keyframe_every < 1))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid delta format! Use: DELTA <topic> <keyframe interval>|OFF");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    if (!can_route(session, {topic}))
+        return;
+    TopicRoute &route = route_for(topic);
+    if (!acl_allows(session, route, topic, AclPublish))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to delta encode topic: " + topic);
+        return;
+    }
+    route.keyframe_every = static_cast<uint32_t>(keyframe_every);
+    route.last_payload.clear();
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("DELTA", client, "Topic: " + topic + " Keyframe interval: " + interval);
+
+    send_message(session, std::string("[SERVER] Delta encoding ") + (keyframe_every ? "enabled" : "disabled") + " for " + topic);
+}
+
+/**
+ * @brief Compress command Handler
+ * Turns dictionary compression of a topic on, a new dictionary is trained every N messages, or OFF
+ *
+ * @param session Client session
+ * @param args Topic name and retrain interval or OFF
+ */
+void handle_compress(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic, interval;
+    iss >> topic >> interval;
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    long retrain_every = 0;
+    if (interval != "OFF" && (!(std::istringstream(interval) >> retrain_every) || retrain_every < DICT_SAMPLES))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid compress format! Use: COMPRESS <topic> <retrain interval of at least " + std::to_string(DICT_SAMPLES) + " messages>|OFF");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    if (!can_route(session, {topic}))
+        return;
+    TopicRoute &route = route_for(topic);
+    if (!acl_allows(session, route, topic, AclPublish))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to compress topic: " + topic);
+        return;
+    }
+    route.retrain_every = static_cast<uint32_t>(retrain_every);
+    route.dictionary_counter = 0;
+    route.compress_generation++;
+    route.training = false;
+    if (retrain_every == 0)
+    {
+        // The version survives so a later dictionary never reuses a number clients may still hold
+        route.trainer.reset();
+        route.dictionary.clear();
+        route.dictionary_frame.reset();
+    }
+    else if (!route.trainer)
+    {
+        route.trainer = std::make_shared<DictionaryTrainer>(DICT_SAMPLES, DICT_SIZE);
+    }
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("COMPRESS", client, "Topic: " + topic + " Retrain interval: " + interval);
+
+    send_message(session, std::string("[SERVER] Compression ") + (retrain_every ? "enabled" : "disabled") + " for " + topic);
+}
+
+/**
+ * @brief Samples a message of a compressed topic and starts a training round once enough samples are collected,
+ * topic_mutex must be held
+ * The first dictionary is trained from consecutive messages, later rounds spread their samples over the retrain interval.
+ * Sampling pauses while a round is training.
+ *
+ * @param route Routing entry of the topic
+ * @param topic Topic name
+ * @param payload Sanitized payload
+ */
+void update_dictionary(TopicRoute &route, const std::string &topic, const std::string &payload)
+{
+    if (route.retrain_every == 0 || route.training)
+        return;
+
+    uint64_t sample_every = route.dictionary.empty() ? 1 : route.retrain_every / DICT_SAMPLES;
+    if (route.dictionary_counter++ % sample_every != 0 || !route.trainer->add(payload))
+        return;
+
+    // The greedy search takes a while, the full trainer is handed to a thread of its own
+    route.training = true;
+    std::shared_ptr<DictionaryTrainer> trainer = std::move(route.trainer);
+    route.trainer = std::make_shared<DictionaryTrainer>(DICT_SAMPLES, DICT_SIZE);
+    std::thread(train_dictionary, topic, route.compress_generation, std::move(trainer)).detach();
+}
+
+/**
+ * @brief Trains a dictionary from a full set of samples without holding topic_mutex, then swaps it in
+ * Subscribers with compression enabled get the new version queued before the first frame compressed with it.
+ *
+ * @param topic Topic name
+ * @param generation COMPRESS setting the samples were collected under
+ * @param trainer Trainer holding the samples
+ */
+void train_dictionary(std::string topic, uint64_t generation, std::shared_ptr<DictionaryTrainer> trainer)
+{
+    std::string dictionary = trainer->train();
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    auto it = topic_subscribers.find(topic);
+    if (it == topic_subscribers.end() || it->second.compress_generation != generation)
+        return;
+
+    TopicRoute &route = it->second;
+    route.training = false;
+    if (dictionary.empty())
+        return;
+
+    route.dictionary_version++;
+    route.dictionary = std::move(dictionary);
+    FrameData dictionary_frame{"[DICT] " + topic + " " + std::to_string(route.dictionary_version) + " " + std::to_string(route.dictionary.size()) + "\n" + route.dictionary};
+    dictionary_frame.control = true;
+    route.dictionary_frame = std::make_shared<const FrameData>(std::move(dictionary_frame));
+
+    // Queued like other frames, so it uses credit and stays behind frames compressed with older versions
+    auto announce = [&](SessionHandle handle)
+    {
+        Session &subscriber = sessions[handle & SESSION_INDEX_MASK];
+        if (subscriber.features.load(std::memory_order_relaxed) & FeatureCompress)
+            deliver_frame(handle, route.dictionary_frame);
+    };
+    for (const SubscriberGroup *group : route.groups)
+    {
+        for (SessionHandle member : group->members)
+            announce(member);
+    }
+    for (const auto &subscriber : route.sampled)
+        announce(subscriber.session);
+}
+
+/**
+ * @brief Archive command Handler
+ * Starts or stops appending every message of a topic to the archive
+ *
+ * @param session Client session
+ * @param args Topic name and ON or OFF
+ */
+void handle_archive(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic, state, extra;
+    if (!(iss >> topic >> state) || (iss >> extra) || (state != "ON" && state != "OFF"))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid archive format! Use: ARCHIVE <topic> ON|OFF");
+        return;
+    }
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    if (!archive)
+    {
+        send_message(session, "[SERVER_ERROR] Archiving is disabled, start the server with --archive-dir");
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(topic_mutex);
+    if (!can_route(session, {topic}))
+        return;
+    if (!acl_allows(session, route_for(topic), topic, AclPublish))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to archive topic: " + topic);
+        return;
+    }
+
+    // Offsets continue after the records on disk, which are read without the routing lock
+    // and only for topics that passed the checks, the route exists from here on
+    if (state == "ON")
+    {
+        lock.unlock();
+        archive->open_topic(topic);
+        lock.lock();
+    }
+    TopicRoute &route = route_for(topic);
+
+    bool interested = route.sessions > 0 || server_consumed(route);
+    route.archived = state == "ON";
+    if (interested != (route.sessions > 0 || server_consumed(route)))
+        notify_interest(topic, !interested);
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("ARCHIVE", client, "Topic: " + topic + " " + state);
+    send_message(session, std::string("[SERVER] Archiving ") + (route.archived ? "enabled" : "disabled") + " for " + topic);
+}
+
+/**
+ * @brief Whether the server itself consumes a topic, through derived topics, the archive or compaction
+ * Such topics count as subscribed for publishers and interest updates
+ *
+ * @param route Routing entry of the topic
+ */
+bool server_consumed(const TopicRoute &route)
+{
+    return !route.derived.empty() || route.archived || route.state;
+}
+
+/**
+ * @brief Compact command Handler
+ * Starts or stops keeping the latest message of every key of a topic for GET
+ *
+ * @param session Client session
+ * @param args Topic name and ON or OFF
+ */
+void handle_compact(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic, state, extra;
+    if (!(iss >> topic >> state) || (iss >> extra) || (state != "ON" && state != "OFF"))
+    {
+        send_message(session, "[SERVER_ERROR] Invalid compact format! Use: COMPACT <topic> ON|OFF");
+        return;
+    }
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    if (!can_route(session, {topic}))
+        return;
+    TopicRoute &route = route_for(topic);
+    if (!acl_allows(session, route, topic, AclPublish))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to compact topic: " + topic);
+        return;
+    }
+
+    bool interested = route.sessions > 0 || server_consumed(route);
+    if (state == "ON" && !route.state)
+    {
+        route.state = std::make_shared<StateTable>();
+        route.state->alias = route.alias;
+        std::lock_guard<std::mutex> state_lock(state_mutex);
+        state_tables[topic] = route.state;
+    }
+    else if (state == "OFF" && route.state)
+    {
+        std::lock_guard<std::mutex> state_lock(state_mutex);
+        state_tables.erase(topic);
+        route.state.reset();
+    }
+    if (interested != (route.sessions > 0 || server_consumed(route)))
+        notify_interest(topic, !interested);
+
+    ClientMetadata client = get_client_metadata(session);
+    log_action("COMPACT", client, "Topic: " + topic + " " + state);
+    send_message(session, std::string("[SERVER] Compaction ") + (route.state ? "enabled" : "disabled") + " for " + topic);
+}
+
+/**
+ * @brief Keeps a keyed message as the latest value of its key, keys beyond MAX_STATE_KEYS are not kept
+ *
+ * @param state State table of the topic
+ * @param key Partition key
+ * @param payload Sanitized payload
+ */
+void update_state(StateTable &state, const std::string &key, const std::string &payload)
+{
+    std::lock_guard<std::mutex> lock(state.mutex);
+    auto value = state.values.find(key);
+    if (value != state.values.end())
+        value->second = payload;
+    else if (state.values.size() < MAX_STATE_KEYS)
+        state.values.emplace(key, payload);
+}
+
+/**
+ * @brief Get command Handler
+ * Answers the latest values of keys of a compacted topic in one reply, routing is never locked
+ *
+ * @param session Client session
+ * @param args Topic name and up to MAX_GET_KEYS keys
+ */
+void handle_get(Session &session, const std::string &args)
+{
+    std::istringstream iss(args);
+    std::string topic, key;
+    std::vector<std::string> keys;
+    iss >> topic;
+    while (iss >> key)
+        keys.push_back(sanitize_topic(key));
+    if (keys.empty() || keys.size() > MAX_GET_KEYS)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid get format! Use: GET <topic> <key> [<key>...], at most " + std::to_string(MAX_GET_KEYS) + " keys");
+        return;
+    }
+    if (std::find(keys.begin(), keys.end(), "") != keys.end())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid key. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    topic = sanitize_topic(topic);
+    if (topic.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    std::shared_ptr<StateTable> state;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        auto table = state_tables.find(topic);
+        if (table != state_tables.end())
+            state = table->second;
+    }
+    if (!state)
+    {
+        send_message(session, "[SERVER_ERROR] Topic is not compacted: " + topic + ", use COMPACT " + topic + " ON");
+        return;
+    }
+
+    // The alias of a route never changes, so the permission check needs no routing entry
+    bool allowed = true;
+    if (acl_rules)
+    {
+        std::lock_guard<std::mutex> lock(session.acl_mutex);
+        allowed = session.acl.allowed(state->alias, topic, AclSubscribe);
+    }
+    if (!allowed)
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to read topic: " + topic);
+        return;
+    }
+
+    std::string reply;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        for (const auto &name : keys)
+        {
+            auto value = state->values.find(name);
+            reply += (reply.empty() ? "" : "\n") + std::string("[VALUE] Topic: ") + topic + " Key: " + name;
+            reply += value == state->values.end() ? " Missing" : " Data: " + value->second;
+        }
+    }
+    send_message(session, reply);
+}
+
+/**
+ * @brief Derive command Handler
+ * Defines a topic published by the server with one aggregate of a source topic per window, OFF removes it.
+ * Defining an existing derived topic again replaces it and starts a new window.
+ *
+ * @param session Client session
+ * @param args Derived topic name, operator, source topic and window in ms, or OFF
+ */
+void handle_derive(Session &session, const std::string &args)
+{
+    static const std::unordered_map<std::string, DeriveOperator> operators = {
+        {"count", DeriveOperator::Count},
+        {"min", DeriveOperator::Min},
+        {"max", DeriveOperator::Max},
+        {"mean", DeriveOperator::Mean},
+        {"last", DeriveOperator::Last}};
+
+    std::istringstream iss(args);
+    std::string name, operation, source, extra;
+    long window_ms = 0;
+    iss >> name >> operation;
+
+    name = sanitize_topic(name);
+    if (name.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+
+    ClientMetadata client = get_client_metadata(session);
+    if (operation == "OFF" && !(iss >> extra))
+    {
+        std::lock_guard<std::mutex> lock(topic_mutex);
+        if (!derived_topics.count(name))
+        {
+            send_message(session, "[SERVER_ERROR] Unknown derived topic: " + name);
+            return;
+        }
+        auto route = topic_subscribers.find(name);
+        if (route != topic_subscribers.end() && !acl_allows(session, route->second, name, AclPublish))
+        {
+            send_message(session, "[SERVER_ERROR] Not allowed to remove derived topic: " + name);
+            return;
+        }
+
+        remove_derived(name);
+        log_action("DERIVE", client, "Topic: " + name + " OFF");
+        send_message(session, "[SERVER] Derived topic " + name + " removed");
+        return;
+    }
+
+    auto op = operators.find(operation);
+    if (op == operators.end() || !(iss >> source >> window_ms) || (iss >> extra) ||
+        window_ms < MIN_DERIVE_WINDOW_MS || window_ms > MAX_DERIVE_WINDOW_MS)
+    {
+        send_message(session, "[SERVER_ERROR] Invalid derive format! Use: DERIVE <topic> count|min|max|mean|last <source> <window of " +
+                                  std::to_string(MIN_DERIVE_WINDOW_MS) + " to " + std::to_string(MAX_DERIVE_WINDOW_MS) + " ms>|OFF");
+        return;
+    }
+
+    source = sanitize_topic(source);
+    if (source.empty())
+    {
+        send_message(session, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
+        return;
+    }
+    if (source == name)
+    {
+        send_message(session, "[SERVER_ERROR] A derived topic cannot aggregate itself");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    if (!derived_topics.count(name) && derived_topics.size() >= MAX_DERIVED_TOPICS)
+    {
+        send_message(session, "[SERVER_ERROR] Too many derived topics, at most " + std::to_string(MAX_DERIVED_TOPICS) + " are allowed.");
+        return;
+    }
+
+    if (!can_route(session, {source, name}))
+        return;
+    // Routes are never erased and map nodes stay put, both references survive the second insert
+    TopicRoute &source_route = route_for(source);
+    TopicRoute &derived_route = route_for(name);
+    if (!acl_allows(session, source_route, source, AclSubscribe) || !acl_allows(session, derived_route, name, AclPublish))
+    {
+        send_message(session, "[SERVER_ERROR] Not allowed to derive " + name + " from " + source);
+        return;
+    }
+
+    remove_derived(name);
+    auto derived = std::make_shared<DerivedTopic>();
+    derived->name = name;
+    derived->source = source;
+    derived->op = op->second;
+    derived->window = std::chrono::milliseconds(window_ms);
+    derived->closes = std::chrono::steady_clock::now() + derived->window;
+
+    if (source_route.sessions == 0 && !server_consumed(source_route))
+        notify_interest(source, true);
+    source_route.derived.push_back(derived);
+    derived_topics[name] = derived;
+    timer_wheel.schedule(derived->window, std::bind(publish_derived, std::weak_ptr<DerivedTopic>(derived)));
+
+    log_action("DERIVE", client, "Topic: " + name + " Operator: " + operation + " Source: " + source + " Window: " + std::to_string(window_ms));
+    send_message(session, "[SERVER] Derived topic " + name + " publishes the " + operation + " of " + source + " every " + std::to_string(window_ms) + " ms");
+}
+
+/**
+ * @brief Removes a derived topic, its pending window timer finds it gone and stops, topic_mutex must be held
+ *
+ * @param name Derived topic name
+ */
+void remove_derived(const std::string &name)
+{
+    auto it = derived_topics.find(name);
+    if (it == derived_topics.end())
+        return;
+
+    const std::string &source = it->second->source;
+    TopicRoute &route = route_for(source);
+    route.derived.erase(std::remove(route.derived.begin(), route.derived.end(), it->second), route.derived.end());
+    if (route.sessions == 0 && !server_consumed(route))
+        notify_interest(source, false);
+    derived_topics.erase(it);
+}
+
+/**
+ * @brief Adds a message of a source topic to the open windows of its derived topics, topic_mutex must be held
+ * The payload is parsed at most once, however many numeric aggregates read it
+ *
+ * @param route Routing entry of the source topic
+ * @param payload Sanitized payload
+ */
+void feed_derived(TopicRoute &route, const std::string &payload)
+{
+    int parsed = -1;
+    double value = 0;
+    for (const auto &derived : route.derived)
+    {
+        derived->messages++;
+        if (derived->op == DeriveOperator::Last)
+        {
+            derived->last = payload;
+            continue;
+        }
+        if (derived->op == DeriveOperator::Count)
+            continue;
+
+        if (parsed < 0)
+            parsed = parse_number(payload, value);
+        if (!parsed)
+            continue;
+
+        if (derived->numbers++ == 0)
+            derived->min = derived->max = value;
+        derived->min = std::min(derived->min, value);
+        derived->max = std::max(derived->max, value);
+        derived->sum += value;
+    }
+}
+
+/**
+ * @brief Timer callback closing the window of a derived topic
+ * Publishes the aggregate to the derived topic like any other message, so it can be subscribed,
+ * sampled or derived from again. Windows without input publish nothing, except a count of 0.
+ *
+ * @param weak_derived Derived topic, expired once it was removed or replaced
+ */
+void publish_derived(std::weak_ptr<DerivedTopic> weak_derived)
+{
+    std::unique_lock<std::mutex> lock(topic_mutex);
+    auto derived = weak_derived.lock();
+    if (!derived)
+        return;
+    if (fenced_topics.count(derived->name))
+    {
+        // A transaction is being committed to the derived topic, its window closes after the batch
+        std::string name = derived->name;
+        derived.reset();
+        wait_for_fences(lock, {name});
+        derived = weak_derived.lock();
+        if (!derived)
+            return;
+    }
+
+    std::ostringstream aggregate;
+    aggregate << std::setprecision(15);
+    switch (derived->op)
+    {
+    case DeriveOperator::Count:
+        aggregate << derived->messages;
+        break;
+    case DeriveOperator::Min:
+        if (derived->numbers)
+            aggregate << derived->min;
+        break;
+    case DeriveOperator::Max:
+        if (derived->numbers)
+            aggregate << derived->max;
+        break;
+    case DeriveOperator::Mean:
+        if (derived->numbers)
+            aggregate << derived->sum / derived->numbers;
+        break;
+    case DeriveOperator::Last:
+        aggregate << derived->last;
+        break;
+    }
+    derived->messages = derived->numbers = 0;
+    derived->min = derived->max = derived->sum = 0;
+    derived->last.clear();
+
+    // Windows stay aligned to the definition, a wheel that fell behind skips the missed ones
+    auto now = std::chrono::steady_clock::now();
+    derived->closes += derived->window;
+    if (derived->closes <= now)
+        derived->closes = now + derived->window;
+    timer_wheel.schedule(std::chrono::duration_cast<std::chrono::milliseconds>(derived->closes - now), std::bind(publish_derived, weak_derived));
+
+    std::string payload = aggregate.str();
+    if (payload.empty())
+        return;
+
+    topic_load.messages.add(derived->name, 1);
+    topic_load.bytes.add(derived->name, payload.size());
+    const PublishMeta meta;
+    fan_out(route_for(derived->name), derived->name, payload, meta, 0);
 }
 
 /**
- * @brief Start the server on a port
+ * @brief Reads the number a message carries, either as plain text like -3 or 100.25, or as Base64 encoded text
  *
- * @param io_context The io_context class provides the core I/O functionality
- * for users of the asynchronous I/O objects
- * @param port Server listening port
+ * @param payload Sanitized payload
+ * @param value Number
+ * @return true Payload is a number
  */
-void start_server(boost::asio::io_context &io_context, int port)
+bool parse_number(const std::string &payload, double &value)
 {
-    tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), port));
+    auto read = [&value](const std::string &text)
+    {
+        char *end = nullptr;
+        value = std::strtod(text.c_str(), &end);
+        return end != text.c_str() && *end == '\0' && std::isfinite(value);
+    };
+    if (read(payload))
+        return true;
 
-    std::cout << "Server started on port " << port << std::endl;
+    if (payload.size() % 4 != 0)
+        return false;
+    std::string text(3 * payload.size() / 4, '\0');
+    int length = EVP_DecodeBlock(reinterpret_cast<unsigned char *>(&text[0]), reinterpret_cast<const unsigned char *>(payload.data()), static_cast<int>(payload.size()));
+    if (length < 0)
+        return false;
+    text.resize(static_cast<size_t>(length) - std::count(payload.end() - 2, payload.end(), '='));
+    return read(text);
+}
 
-    while (true)
+/**
+ * @brief Reads the start of a replay, all times are UTC
+ * Accepts milliseconds since the epoch, YYYY-MM-DDTHH:MM:SS[Z] or HH:MM:SS of the current day.
+ *
+ * @param text Time as given to SUBSCRIBE FROM
+ * @param timestamp_ms Milliseconds since the epoch
+ * @return true Time is valid
+ */
+bool parse_replay_time(const std::string &text, uint64_t &timestamp_ms)
+{
+    if (!text.empty() && text.size() <= 19 && text.find_first_not_of("0123456789") == std::string::npos)
     {
-        auto socket = std::make_shared<tcp::socket>(io_context);
-        acceptor.accept(*socket);
-        std::thread(client_handler, socket).detach();
+        timestamp_ms = std::stoull(text);
+        return true;
+    }
+
+    std::tm time{};
+    std::istringstream iss(text);
+    if (text.size() == 8)
+    {
+        std::time_t now = std::time(nullptr);
+        gmtime_r(&now, &time);
+        iss >> std::get_time(&time, "%H:%M:%S");
     }
+    else
+    {
+        iss >> std::get_time(&time, "%Y-%m-%dT%H:%M:%S");
+        if (iss.peek() == 'Z')
+            iss.get();
+    }
+    if (iss.fail() || iss.peek() != std::char_traits<char>::eof())
+        return false;
+
+    std::time_t seconds = timegm(&time);
+    if (seconds < 0)
+        return false;
+    timestamp_ms = static_cast<uint64_t>(seconds) * 1000;
+    return true;
 }
 
 /**
- * @brief Handles interactions with the client
+ * @brief Sends archived messages of a topic as [REPLAY] lines, batched into few writes
+ * Replayed messages bypass credit and delivery modes, the subscription applies from the live messages on.
  *
- * @param socket TCP Socket
+ * @param session Client session
+ * @param topic Topic name
+ * @param cursor Replay position, moved past the sent messages
+ * @param end_offset Offset at which to stop
+ * @return size_t Messages sent
  */
-void client_handler(std::shared_ptr<tcp::socket> socket)
+size_t send_replay(Session &session, const std::string &topic, ArchiveCursor &cursor, uint64_t end_offset)
 {
-    try
-    {
-        char data[1024];
-
-        while (true)
+    std::string batch;
+    size_t sent = archive->replay(topic, cursor, end_offset, [&](const ArchiveRecordView &record)
+                                  {
+        if (!batch.empty())
+            batch += '\n';
+        batch += "[REPLAY] Topic: " + topic + " Offset: " + std::to_string(record.offset) + " Time: " + std::to_string(record.timestamp_ms);
+        if (record.key_size)
+            batch.append(" Key: ").append(record.key, record.key_size);
+        batch.append(" Data: ").append(record.payload, record.payload_size);
+        if (batch.size() >= REPLAY_BATCH_BYTES)
         {
-            boost::system::error_code error;
-            size_t length = socket->read_some(boost::asio::buffer(data), error);
+            send_message(session, batch);
+            batch.clear();
+        } });
+    if (!batch.empty())
+        send_message(session, batch);
+    return sent;
+}
 
-            if (error == boost::asio::error::eof)
-            {
-                ClientMetadata clinet = get_client_metadata(socket);
-                log_action("DISCONNECT", clinet, error.message());
-                break;
-            }
-            else if (error)
-            {
-                throw boost::system::system_error(error);
-            }
+/**
+ * @brief Resync command Handler
+ * A client that lost the base of a delta stream asks for a keyframe with the next message
+ *
+ * @param session Client session
+ * @param args Topic name
+ */
+void handle_resync(Session &session, const std::string &args)
+{
+    std::lock_guard<std::mutex> lock(topic_mutex);
+    session.delta_streams.erase(sanitize_topic(args));
+}
 
-            std::string message(data, length);
-            message.erase(std::remove(message.begin(), message.end(), '\n'), message.end()); // Trim newlines
+/**
+ * @brief Checks that routing the topics stays within max_topics, topic_mutex must be held
+ * Commands creating routes call this first, the client gets an error otherwise
+ *
+ * @param session Client session
+ * @param topics Topics the command routes
+ * @return true Topics exist or fit
+ */
+bool can_route(Session &session, std::initializer_list<std::string> topics)
+{
+    size_t added = 0;
+    for (const auto &topic : topics)
+        added += !topic_subscribers.count(topic);
+    if (topic_subscribers.size() + added <= max_topics)
+        return true;
 
-            std::cout << "[received] '" << message << "'" << std::endl;
+    send_message(session, "[SERVER_ERROR] Too many topics, at most " + std::to_string(max_topics) + " are allowed.");
+    return false;
+}
 
-            size_t space1 = message.find(' ');
-            std::string command = (space1 == std::string::npos) ? message : message.substr(0, space1);
-            std::string args = (space1 == std::string::npos) ? "" : message.substr(space1 + 1);
+/**
+ * @brief Returns the routing entry of a topic, assigning its alias on first use, topic_mutex must be held
+ *
+ * @param topic Topic name
+ * @return TopicRoute& Routing entry
+ */
+TopicRoute &route_for(const std::string &topic)
+{
+    auto it = topic_subscribers.find(topic);
+    if (it != topic_subscribers.end())
+        return it->second;
 
-            auto it = command_handlers.find(command);
-            if (it != command_handlers.end())
-            {
-                it->second(socket, args);
-            }
-            else
-            {
-                send_message(socket, "[SERVER_ERROR] Unknown command: " + command);
-            }
-        }
-    }
-    catch (std::exception &e)
-    {
-        std::cerr << "Client error: " << e.what() << std::endl;
-    }
+    TopicRoute &route = topic_subscribers[topic];
+    route.alias = static_cast<uint32_t>(alias_topics.size());
+    alias_topics.push_back(topic);
+    return route;
 }
 
 /**
- * @brief Initialize command handlers
+ * @brief Checks a permission of a session on a routed topic, topic_mutex must be held
+ * Once the topic is resolved for the session this is a single bit test
  *
+ * @param session Client session
+ * @param route Routing entry, its alias is the topic id
+ * @param topic Topic name
+ * @param permission Permission to test
+ * @return true No ACL is loaded or the permission is granted
  */
-void setup_command_handlers()
+bool acl_allows(Session &session, const TopicRoute &route, const std::string &topic, AclPermission permission)
 {
-    command_handlers["CONNECT"] = handle_connect;
-    command_handlers["DISCONNECT"] = handle_disconnect;
-    command_handlers["SUBSCRIBE"] = handle_subscribe;
-    command_handlers["UNSUBSCRIBE"] = handle_unsubscribe;
-    command_handlers["PUBLISH"] = handle_publish;
+    if (!acl_rules)
+        return true;
+    std::lock_guard<std::mutex> lock(session.acl_mutex);
+    return session.acl.allowed(route.alias, topic, permission);
 }
 
 /**
- * @brief Connect command Handler
+ * @brief Construct the frame cache of a message, topic_mutex must be held
+ * A delta encoded topic advances its version and hands its last payload over as the delta base
  *
- * @param socket TCP Socket
- * @param args Client connection parameters
+ * @param route Routing entry of the topic
+ * @param topic Topic name
+ * @param payload Sanitized payload
+ * @param meta Header block and TTL of the message
+ * @param trace_id Trace id or 0
  */
-void handle_connect(std::shared_ptr<tcp::socket> socket, const std::string &args)
+FrameCache::FrameCache(TopicRoute &route, const std::string &topic, const std::string &payload, const PublishMeta &meta, uint64_t trace_id)
+    : topic(topic), payload(payload), header(meta.header), trace_id(trace_id), alias(route.alias)
 {
-    std::lock_guard<std::mutex> lock(client_mutex);
-
-    std::istringstream iss(args);
-    int client_port;
-    std::string client_name;
-    int client_pid;
-
-    // Ensure correct parsing of: CONNECT <serverPort> <clientName> <PID>
-    if (!(iss >> client_port >> client_name >> client_pid))
-    {
-        ClientMetadata client = get_client_metadata(socket);
-        log_action("CONNECTION_ERROR", client, "Client connect message is malformed.");
-        return;
-    }
+    if (meta.ttl_ms > 0)
+        expires = std::chrono::steady_clock::now() + std::chrono::milliseconds(meta.ttl_ms);
 
-    // Ensure unique client name (append `-PID` if duplicate)
-    std::string original_name = client_name;
-    for (const auto &pair : connected_clients)
+    if (!route.dictionary.empty())
     {
-        if (pair.second.name == client_name)
-        {
-            client_name = original_name + "-" + std::to_string(client_pid);
-            break;
-        }
+        dictionary = &route.dictionary;
+        dictionary_version = route.dictionary_version;
     }
 
-    // Store client info
-    connected_clients[socket] = {socket, client_name, client_pid};
-
-    ClientMetadata client = get_client_metadata(socket);
-    log_action("CONNECT", client, "success");
+    if (route.keyframe_every == 0)
+        return;
 
-    send_message(socket, "[SERVER] Connected as " + client_name);
+    version = ++route.version;
+    keyframe_only = route.last_payload.empty() || version % route.keyframe_every == 0;
+    base = std::move(route.last_payload);
+    route.last_payload = payload;
 }
 
 /**
- * @brief Disconnect command Handler
- * Disconnects a client form the server
+ * @brief Returns the format of the message for a subscriber, building it on first use
+ * Routed handles are current while topic_mutex is held, so the session slot can be read directly
  *
- * @param socket TCP Socket
+ * @param handle Subscriber session handle
+ * @return const Frame& Shared frame
  */
-void handle_disconnect(std::shared_ptr<tcp::socket> socket, const std::string &)
+const Frame &FrameCache::for_session(SessionHandle handle)
 {
-    std::lock_guard<std::mutex> lock(client_mutex);
-    auto it = connected_clients.find(socket);
+    Session &session = sessions[handle & SESSION_INDEX_MASK];
+    uint32_t features = session.features.load(std::memory_order_relaxed);
+    if (version == 0 || !(features & FeatureDelta) || with_header(features))
+        return frame(plain_encoding(features), features);
 
-    if (it != connected_clients.end())
-    {
-        ClientMetadata client = get_client_metadata(socket);
+    // Sessions that got the previous version share one delta, all others resync with the keyframe
+    DeltaStream &stream = session.delta_streams[topic];
+    uint64_t dropped = session.frames_dropped.load(std::memory_order_relaxed);
+    bool in_sync = !keyframe_only && stream.version == version - 1 && stream.dropped == dropped;
+    stream.version = version;
+    stream.dropped = dropped;
 
-        // Remove client from all topics
-        {
-            std::lock_guard<std::mutex> topic_lock(topic_mutex);
-            for (auto &pair : topic_subscribers)
-            {
-                pair.second.erase(std::remove(pair.second.begin(), pair.second.end(), socket), pair.second.end());
-            }
-        }
+    return frame(in_sync ? EncodingDelta : EncodingKeyframe, features);
+}
 
-        log_action("DISCONNECT", client, "success");
+/**
+ * @brief Returns the format for a sampled or rate limited subscription
+ * These skip versions, so delta sessions always get self-contained keyframes
+ *
+ * @param handle Subscriber session handle
+ * @return const Frame& Shared frame
+ */
+const Frame &FrameCache::for_sampled(SessionHandle handle)
+{
+    uint32_t features = sessions[handle & SESSION_INDEX_MASK].features.load(std::memory_order_relaxed);
+    if (version == 0 || !(features & FeatureDelta) || with_header(features))
+        return frame(plain_encoding(features), features);
+    return frame(EncodingKeyframe, features);
+}
 
-        connected_clients.erase(it);
-        send_message(socket, "[SERVER] Disconnected");
+/**
+ * @brief Picks the encoding of a message that is not delta encoded for a subscriber
+ * Header frames for header sessions, compressed when the session asked for it and the payload shrinks,
+ * compact for alias sessions, text otherwise. A header frame breaks the delta chain, the next delta resyncs.
+ *
+ * @param features SessionFeature bits of the subscriber
+ */
+FrameEncoding FrameCache::plain_encoding(uint32_t features)
+{
+    if (with_header(features))
+        return EncodingHeaders;
+    if (dictionary && (features & FeatureCompress))
+    {
+        // Incompressible payloads clear the dictionary, every session falls back to its uncompressed frame
+        if (frames[EncodingCompressed] || frame(EncodingCompressed, 0))
+            return EncodingCompressed;
     }
+    return (features & FeatureAliases) ? EncodingCompact : EncodingText;
 }
 
 /**
- * @brief Subscribe command Handler
- * Subscribes a client to a topic and and if topic is non existant creates a new one
+ * @brief Returns an encoding written for the transport of the subscriber, building it on first use
+ * Event streams carry the payload only, so they always get a data event of the text encoding
  *
- * @param socket TCP Socket
- * @param topic Topic name
+ * @param encoding Message encoding
+ * @param features SessionFeature bits of the subscriber
+ * @return const Frame& Shared frame, null only for an incompressible EncodingCompressed
  */
-void handle_subscribe(std::shared_ptr<tcp::socket> socket, std::string topic)
+const Frame &FrameCache::frame(FrameEncoding encoding, uint32_t features)
 {
-    topic = sanitize_topic(topic);
-    if (topic.empty())
+    FrameTransport transport = (features & FeatureWebSocket)     ? TransportWebSocket
+                               : (features & FeatureEventStream) ? TransportEventStream
+                                                                 : TransportStream;
+    if (transport == TransportEventStream)
+        encoding = EncodingText;
+
+    Frame &cached = frames[transport * EncodingCount + encoding];
+    if (cached)
+        return cached;
+
+    if (transport == TransportEventStream)
     {
-        send_message(socket, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
-        return;
+        cached = std::make_shared<const FrameData>(FrameData{"event: " + topic + "\ndata: " + payload + "\n\n", trace_id, expires});
+        return cached;
     }
 
-    std::lock_guard<std::mutex> lock(topic_mutex);
+    if (transport == TransportWebSocket)
+    {
+        const Frame &stream = frame(encoding, 0);
+        if (!stream)
+            return stream;
 
-    auto &subscribers = topic_subscribers[topic];
+        // Text encodings drop their line terminator, the compressed header line stays in front of the bytes
+        const std::string &data = stream->data;
+        cached = std::make_shared<const FrameData>(FrameData{
+            encoding == EncodingCompressed ? websocket_frame(data, WebSocketOpcode::Binary)
+                                           : websocket_frame(data.substr(0, data.size() - 1), WebSocketOpcode::Text),
+            trace_id, expires});
+        return cached;
+    }
 
-    // Check if the socket is already subscribed using `get()` to compare raw pointers
-    auto it = std::find_if(subscribers.begin(), subscribers.end(),
-                           [&](const std::shared_ptr<tcp::socket> &s)
-                           { return s.get() == socket.get(); });
+    std::string data = encode(encoding);
+    if (!data.empty())
+        cached = std::make_shared<const FrameData>(FrameData{std::move(data), trace_id, expires});
+    else if (encoding == EncodingDelta)
+        cached = frame(EncodingKeyframe, 0);
+    else
+        dictionary = nullptr;
+    return cached;
+}
 
-    if (it == subscribers.end()) // Only add if not already subscribed
+/**
+ * @brief Encodes the message for a plain stream connection
+ *
+ * @param encoding Message encoding
+ * @return std::string Frame bytes, empty when a delta or compressed frame would not be smaller than the payload
+ */
+std::string FrameCache::encode(FrameEncoding encoding)
+{
+    switch (encoding)
     {
-        subscribers.push_back(socket);
+    case EncodingCompact:
+        return "#" + std::to_string(alias) + " " + payload + "\n";
+    case EncodingKeyframe:
+        return "[KEY] " + topic + " " + std::to_string(version) + " " + payload + "\n";
+    case EncodingDelta:
+    {
+        // A delta that does not rebuild the payload exactly falls back to a keyframe
+        std::string ops = delta_encode(base, payload), rebuilt;
+        if (ops.size() >= payload.size() || !delta_apply(base, ops, rebuilt) || rebuilt != payload)
+            return "";
+        return "[DELTA] " + topic + " " + std::to_string(version) + " " + std::to_string(version - 1) + " " + ops + "\n";
     }
-    else
+    case EncodingCompressed:
     {
-        send_message(socket, "[SERVER] Already subscribed to " + topic);
-        return;
+        std::string bytes;
+        if (!compressor.compress(*dictionary, payload, bytes) || bytes.size() >= payload.size())
+            return "";
+        return "[Z] " + topic + " " + std::to_string(dictionary_version) + " " + std::to_string(bytes.size()) + "\n" + bytes;
+    }
+    case EncodingHeaders:
+        return "[HMessage] Topic: " + topic + " Header: " + header + " Data: " + payload + "\n";
+    default:
+        return "[Message] Topic: " + topic + " Data: " + payload + "\n";
     }
-
-    // Fetch client metadata
-    ClientMetadata client = get_client_metadata(socket);
-    log_action("SUBSCRIBE", client, "Topic: " + topic);
-
-    send_message(socket, "[SERVER] Subscribed to " + topic);
 }
 
 /**
- * @brief Unsubscribe command Handler
- * Unsubscribes the client form the given topic
+ * @brief Utility function to send messages to a client
  *
- * @param socket TCP Socket
- * @param topic Topic name
+ * @param session Client session
+ * @param message Message that is sent to the client
  */
-void handle_unsubscribe(std::shared_ptr<tcp::socket> socket, std::string topic)
+void send_message(Session &session, const std::string &message)
 {
-    topic = sanitize_topic(topic);
-    if (topic.empty())
+    uint32_t features = session.features.load(std::memory_order_relaxed);
+    std::string frame;
+    if (features & FeatureWebSocket)
     {
-        send_message(socket, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
-        return;
+        frame = websocket_frame(message, WebSocketOpcode::Text);
     }
-
-    std::lock_guard<std::mutex> lock(topic_mutex);
-
-    auto it = topic_subscribers.find(topic);
-    if (it == topic_subscribers.end() || it->second.empty())
+    else if (features & FeatureEventStream)
     {
-        send_message(socket, "[SERVER_ERROR] You are not subscribed to " + topic);
-        return;
+        // Control replies become comments, EventSource clients only see messages
+        std::istringstream lines(message);
+        std::string line;
+        while (std::getline(lines, line))
+            frame += ": " + line + "\n";
+        frame += "\n";
+    }
+    else
+    {
+        frame = message + "\n";
     }
 
-    auto &subscribers = it->second;
-
-    // Find and remove the correct socket using raw pointer comparison
-    auto sub_it = std::remove_if(subscribers.begin(), subscribers.end(),
-                                 [&](const std::shared_ptr<tcp::socket> &s)
-                                 { return s.get() == socket.get(); });
+    std::lock_guard<std::mutex> lock(session.write_mutex);
+    boost::system::error_code error;
+    write_socket(session, frame, error);
+    if (error)
+        throw boost::system::system_error(error);
+}
 
-    if (sub_it == subscribers.end())
+/**
+ * @brief Writes bytes to the session socket, write_mutex must be held
+ * Plaintext and kernel TLS sessions write the socket directly, so fan-out keeps the plain socket path.
+ * Only user space TLS goes through OpenSSL.
+ *
+ * @param session Client session
+ * @param data Bytes
+ * @param error Write error
+ */
+void write_socket(Session &session, const std::string &data, boost::system::error_code &error)
+{
+    if (session.tls && !session.tls->kernel_send())
     {
-        send_message(socket, "[SERVER_ERROR] You are not subscribed to " + topic);
+        if (!session.tls->write(data.data(), data.size()))
+            error = boost::asio::error::broken_pipe;
         return;
     }
+    boost::asio::write(*session.socket, boost::asio::buffer(data), error);
+}
+
+/**
+ * @brief Reads bytes from the session socket, only called by the handler thread of the session
+ *
+ * @param session Client session
+ * @param data Buffer
+ * @param size Buffer size
+ * @param error Read error, eof once the client closed the connection
+ * @return size_t Bytes read
+ */
+size_t read_socket(Session &session, char *data, size_t size, boost::system::error_code &error)
+{
+    if (!session.tls)
+        return session.socket->read_some(boost::asio::buffer(data, size), error);
 
-    subscribers.erase(sub_it, subscribers.end());
+    // OpenSSL also reads kernel TLS sockets, it takes alerts and handshake records out of band
+    long length = session.tls->read(data, size);
+    if (length == 0)
+        error = boost::asio::error::eof;
+    else if (length < 0)
+        error = boost::asio::error::connection_reset;
+    return length > 0 ? static_cast<size_t>(length) : 0;
+}
 
-    // Fetch client metadata
-    ClientMetadata client = get_client_metadata(socket);
-    log_action("UNSUBSCRIBE", client, topic);
+/**
+ * @brief Writes an already framed message to a client
+ *
+ * @param session Client session
+ * @param handle Handle the frame was addressed to, nothing is written if it went stale
+ * @param frame Shared frame including the trailing newline
+ * @return true Frame was written
+ * @return false Session is gone or the write failed
+ */
+bool send_frame(Session &session, SessionHandle handle, const Frame &frame)
+{
+    std::lock_guard<std::mutex> lock(session.write_mutex);
+    if (!is_current(session, handle))
+        return false;
 
-    send_message(socket, "[SERVER] Unsubscribed from " + topic);
+    boost::system::error_code error;
+    write_socket(session, frame->data, error);
+    tracer.record(frame->trace_id, TraceStage::WriteComplete, handle);
+    return !error;
 }
 
 /**
- * @brief Publish command Handler
- * Publishes data to a topic and sends it to all subscribed clients
+ * @brief Delivers a frame to a subscriber honoring its credit window
+ * Without credit the frame is queued, an overflowing backlog is handled by the slow consumer policy
  *
- * @param socket TCP Socket
- * @param args Arguments are topic name and topic payload, all ASCII
+ * @param handle Subscriber session handle
+ * @param frame Shared frame
+ * @return true Frame was written or queued
+ * @return false Subscriber is gone
  */
-void handle_publish(std::shared_ptr<tcp::socket> socket, const std::string &args)
+bool deliver_frame(SessionHandle handle, const Frame &frame)
 {
-    size_t space = args.find(' ');
-    if (space == std::string::npos)
-    {
-        send_message(socket, "[SERVER_ERROR] Invalid publish format! Topic or message missing.");
-        return;
-    }
+    Session *session = resolve_session(handle);
+    if (!session)
+        return false;
 
-    std::string topic = sanitize_topic(args.substr(0, space)); // Sanitize topic
-    if (topic.empty())
+    tracer.record(frame->trace_id, TraceStage::Enqueue, handle);
     {
-        send_message(socket, "[SERVER_ERROR] Invalid topic. Only letters (A-Z, a-z), numbers (0-9), and max length of 64 are allowed.");
-        return;
-    }
+        std::lock_guard<std::mutex> lock(session->flow_mutex);
+        if (!is_current(*session, handle))
+            return false;
 
-    std::string payload = sanitize_message(args.substr(space + 1)); // Sanitize message
-    if (payload.empty())
-    {
-        send_message(socket, "[SERVER_ERROR] Invalid message. Only Base64 characters (A-Z, a-z, 0-9, +, /, =) and max length of 1024 are allowed.");
-        return;
+        FlowControl &flow = session->flow;
+        if (session->flow_enabled || flow.replaying || flow.draining || !flow.backlog.empty())
+        {
+            if (flow.replaying || flow.draining || !flow.backlog.empty() || !flow.has_credit(frame->data.size()))
+            {
+                if (flow.backlog.size() >= max_backlog && !frame->control)
+                {
+                    switch (slow_consumer_policy)
+                    {
+                    case SlowConsumerPolicy::DropNewest:
+                        session->frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                        return true;
+                    case SlowConsumerPolicy::DropOldest:
+                    {
+                        auto oldest = std::find_if(flow.backlog.begin(), flow.backlog.end(), [](const Frame &queued)
+                                                   { return !queued->control; });
+                        if (oldest == flow.backlog.end())
+                            break;
+                        session->frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                        flow.backlog_bytes -= (*oldest)->data.size();
+                        flow.backlog.erase(oldest);
+                        break;
+                    }
+                    case SlowConsumerPolicy::Disconnect:
+                        boost::system::error_code ignored;
+                        session->socket->shutdown(tcp::socket::shutdown_both, ignored);
+                        return false;
+                    }
+                }
+                flow.backlog.push_back(frame);
+                flow.backlog_bytes += frame->data.size();
+                return true;
+            }
+            flow.consume(frame->data.size());
+        }
     }
 
-    std::lock_guard<std::mutex> lock(topic_mutex);
-    auto it = topic_subscribers.find(topic);
+    return send_frame(*session, handle, frame);
+}
 
-    if (it == topic_subscribers.end() || it->second.empty())
+/**
+ * @brief Delivers a frame to a sampled or rate limited subscription
+ * Skipped frames cost a counter increment, frames inside the rate interval replace the conflation slot
+ *
+ * @param subscriber Subscription with sampling state
+ * @param frame Shared frame
+ * @return true Frame was written, conflated or skipped
+ * @return false Subscriber is gone
+ */
+bool deliver_sampled(const Subscriber &subscriber, const Frame &frame)
+{
+    Downsampler &sampling = *subscriber.sampling;
     {
-        send_message(socket, "[SERVER_ERROR] No subscribers for topic: " + topic);
-        return;
+        std::lock_guard<std::mutex> lock(sampling.mutex);
+        if (sampling.sample_counter++ % sampling.sample_every != 0)
+            return true;
+
+        if (sampling.interval.count() > 0)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (sampling.flush_scheduled || now < sampling.next_send)
+            {
+                sampling.conflated = frame;
+                if (!sampling.flush_scheduled)
+                {
+                    sampling.flush_scheduled = true;
+                    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(sampling.next_send - now);
+                    timer_wheel.schedule(delay, std::bind(flush_conflated, subscriber.session, std::weak_ptr<Downsampler>(subscriber.sampling)));
+                }
+                return true;
+            }
+            sampling.next_send = now + sampling.interval;
+        }
     }
 
-    ClientMetadata client = get_client_metadata(socket);
-    log_action("PUBLISH", client, "Topic: " + topic + " Message: " + payload);
+    return deliver_frame(subscriber.session, frame);
+}
+
+/**
+ * @brief Timer callback writing the latest conflated frame of a rate limited subscription
+ *
+ * @param handle Subscriber session handle
+ * @param weak_sampling Sampling state, expired once the subscription is gone
+ */
+void flush_conflated(SessionHandle handle, std::weak_ptr<Downsampler> weak_sampling)
+{
+    auto sampling = weak_sampling.lock();
+    if (!sampling)
+        return;
 
-    for (auto subscriber : it->second)
+    Frame frame;
     {
-        try
-        {
-            send_message(subscriber, "[Message] Topic: " + topic + " Data: " + payload);
-        }
-        catch (const std::exception &)
-        {
-            topic_subscribers[topic].erase(std::remove(topic_subscribers[topic].begin(), topic_subscribers[topic].end(), subscriber),
-                                           topic_subscribers[topic].end());
-        }
+        std::lock_guard<std::mutex> lock(sampling->mutex);
+        frame = std::move(sampling->conflated);
+        sampling->conflated.reset();
+        sampling->flush_scheduled = false;
+        sampling->next_send = std::chrono::steady_clock::now() + sampling->interval;
     }
+
+    if (frame && frame->expires > std::chrono::steady_clock::now())
+        deliver_frame(handle, frame);
 }
 
 /**
- * @brief Utility function to send messages to a client
+ * @brief Writes queued frames while the subscriber has credit left, or all of them once a replay ended without flow control
+ * Publishers queue behind a running drain so frames keep their order. Frames whose TTL ran out
+ * while queued are dropped without using credit.
  *
- * @param socket TCP Socket
- * @param message Message that is sent to the client
+ * @param session Subscriber session
  */
-void send_message(std::shared_ptr<tcp::socket> socket, const std::string &message)
+void drain_backlog(Session &session)
 {
-    boost::asio::write(*socket, boost::asio::buffer(message + "\n"));
+    SessionHandle handle = session.handle;
+    while (true)
+    {
+        Frame frame;
+        {
+            std::lock_guard<std::mutex> lock(session.flow_mutex);
+            FlowControl &flow = session.flow;
+            auto now = std::chrono::steady_clock::now();
+            while (!flow.backlog.empty() && flow.backlog.front()->expires <= now)
+            {
+                session.frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                flow.backlog_bytes -= flow.backlog.front()->data.size();
+                flow.backlog.pop_front();
+            }
+
+            if (flow.replaying || flow.backlog.empty() || (session.flow_enabled && !flow.has_credit(flow.backlog.front()->data.size())))
+            {
+                flow.draining = false;
+                return;
+            }
+
+            flow.draining = true;
+            frame = flow.backlog.front();
+            flow.backlog.pop_front();
+            flow.backlog_bytes -= frame->data.size();
+            if (session.flow_enabled)
+                flow.consume(frame->data.size());
+        }
+
+        if (!send_frame(session, handle, frame))
+            return;
+    }
 }
 
 /**
@@ -487,24 +4106,39 @@ std::string sanitize_message(const std::string &message)
 /**
  * @brief Gets metadata form thee client
  *
- * @param socket TCP Socket
+ * @param session Client session
  * @return ClientMetadata Clients metadata structure
  */
-ClientMetadata get_client_metadata(std::shared_ptr<tcp::socket> socket)
+ClientMetadata get_client_metadata(Session &session)
 {
     ClientMetadata metadata;
-    auto it = connected_clients.find(socket);
-    if (it != connected_clients.end())
+    if (session.connected)
     {
-        metadata.name = it->second.name;
-        metadata.ip = socket->remote_endpoint().address().to_string();
-        metadata.client_pid = it->second.pid;
-        metadata.client_port = socket->remote_endpoint().port();
-        metadata.server_port = socket->local_endpoint().port();
+        metadata.name = session.name;
+        metadata.ip = session.socket->remote_endpoint().address().to_string();
+        metadata.client_pid = session.pid;
+        metadata.client_port = session.socket->remote_endpoint().port();
+        metadata.server_port = session.socket->local_endpoint().port();
     }
     return metadata;
 }
 
+/**
+ * @brief Key identifying a client in load statistics
+ *
+ * @param session Client session
+ * @return std::string Client name or remote endpoint for anonymous clients
+ */
+std::string get_client_key(Session &session)
+{
+    if (session.connected)
+        return session.name;
+
+    boost::system::error_code error;
+    auto endpoint = session.socket->remote_endpoint(error);
+    return error ? "unknown" : endpoint.address().to_string() + ":" + std::to_string(endpoint.port());
+}
+
 /**
  * @brief Utility function to log client actions
  *
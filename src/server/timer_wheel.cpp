@@ -0,0 +1,114 @@
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+/**
+ * @brief Construct a new Timer Wheel
+ *
+ * @param tick Resolution of the wheel
+ * @param slots Number of slots, delays longer than one revolution take extra rounds
+ */
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, size_t slots)
+    : tick(tick), slots(slots)
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    stop();
+}
+
+/**
+ * @brief Starts the wheel thread
+ *
+ */
+void TimerWheel::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running)
+        return;
+    running = true;
+    worker = std::thread(&TimerWheel::run, this);
+}
+
+/**
+ * @brief Stops the wheel thread, pending timers are discarded
+ *
+ */
+void TimerWheel::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    wakeup.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+/**
+ * @brief Schedules a one shot callback
+ * Callbacks run on the wheel thread and may schedule further timers
+ *
+ * @param delay Delay, rounded up to whole ticks
+ * @param callback Function to run on expiry
+ */
+void TimerWheel::schedule(std::chrono::milliseconds delay, Callback callback)
+{
+    uint64_t ticks = std::max<uint64_t>(1, (delay.count() + tick.count() - 1) / tick.count());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t slot = (cursor + ticks) % slots.size();
+    slots[slot].push_back({(ticks - 1) / slots.size(), std::move(callback)});
+}
+
+/**
+ * @brief Wheel thread, advances one slot per tick and fires expired timers
+ *
+ */
+void TimerWheel::run()
+{
+    auto next = std::chrono::steady_clock::now() + tick;
+
+    while (true)
+    {
+        std::vector<Callback> expired;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (wakeup.wait_until(lock, next, [this]
+                                  { return !running; }))
+                return;
+            next += tick;
+
+            cursor = (cursor + 1) % slots.size();
+            auto &timers = slots[cursor];
+            for (size_t i = 0; i < timers.size();)
+            {
+                if (timers[i].rounds > 0)
+                {
+                    timers[i].rounds--;
+                    ++i;
+                    continue;
+                }
+                expired.push_back(std::move(timers[i].callback));
+                timers[i] = std::move(timers.back());
+                timers.pop_back();
+            }
+        }
+
+        for (auto &callback : expired)
+        {
+            try
+            {
+                callback();
+            }
+            catch (std::exception &e)
+            {
+                std::cerr << "Timer error: " << e.what() << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Hashed timer wheel driven by a single thread
+ * Scheduling and expiry are O(1), timers fire with a resolution of one tick
+ */
+class TimerWheel
+{
+public:
+    using Callback = std::function<void()>;
+
+    TimerWheel(std::chrono::milliseconds tick, size_t slots);
+    ~TimerWheel();
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    void start();
+    void stop();
+    void schedule(std::chrono::milliseconds delay, Callback callback);
+
+private:
+    struct Timer
+    {
+        uint64_t rounds;
+        Callback callback;
+    };
+
+    void run();
+
+    std::chrono::milliseconds tick;
+    std::vector<std::vector<Timer>> slots;
+    size_t cursor = 0;
+    bool running = false;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::thread worker;
+};
@@ -0,0 +1,162 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace
+{
+    struct TraceEvent
+    {
+        uint64_t trace_id;
+        uint64_t timestamp;
+        uint64_t detail;
+        TraceStage stage;
+    };
+
+    void write_span(std::ostream &out, bool &first, const char *name, uint64_t trace_id, uint64_t start, uint64_t end, uint64_t origin, uint64_t detail, uint64_t header)
+    {
+        if (end < start)
+            return;
+        out << (first ? "\n" : ",\n")
+            << "{\"name\":\"" << name << "\",\"cat\":\"message\",\"ph\":\"X\",\"pid\":1,\"tid\":" << trace_id
+            << ",\"ts\":" << (start - origin) / 1000.0 << ",\"dur\":" << (end - start) / 1000.0
+            << ",\"args\":{\"subscriber\":" << detail;
+        if (header)
+            out << ",\"header_trace_id\":\"" << header << "\"";
+        out << "}}";
+        first = false;
+    }
+}
+
+/**
+ * @brief Construct a new Tracer
+ *
+ * @param capacity Ring capacity in events, rounded up to a power of two
+ */
+Tracer::Tracer(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    slots = std::make_unique<Slot[]>(size);
+    mask = size - 1;
+}
+
+/**
+ * @brief Slow path of begin(), only reached while tracing is enabled
+ *
+ */
+uint64_t Tracer::sample(uint32_t n)
+{
+    if (counter.fetch_add(1, std::memory_order_relaxed) % n != 0)
+        return 0;
+    return next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+/**
+ * @brief Records a stage timestamp of a sampled message
+ *
+ * @param trace_id Trace id from begin(), nothing is recorded for 0
+ * @param stage Stage reached
+ * @param detail Stage detail, the subscriber for enqueue and write stages
+ * @param timestamp Timestamp in ns, 0 takes the current time
+ */
+void Tracer::record(uint64_t trace_id, TraceStage stage, uint64_t detail, uint64_t timestamp)
+{
+    if (trace_id == 0)
+        return;
+    if (timestamp == 0)
+        timestamp = now_ns();
+
+    uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = slots[index & mask];
+
+    // Odd sequence marks the slot as being written
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.trace_id.store(trace_id, std::memory_order_relaxed);
+    slot.timestamp.store(timestamp, std::memory_order_relaxed);
+    slot.detail.store(detail, std::memory_order_relaxed);
+    slot.stage.store(static_cast<uint8_t>(stage), std::memory_order_relaxed);
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+/**
+ * @brief Writes the buffered traces as Chrome trace-event JSON
+ * Every message becomes one track with parse, route, enqueue and write spans
+ *
+ * @param out Output stream
+ * @return size_t Number of exported messages
+ */
+size_t Tracer::export_chrome_json(std::ostream &out) const
+{
+    std::map<uint64_t, std::vector<TraceEvent>> traces;
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > mask + 1 ? end - (mask + 1) : 0;
+
+    for (uint64_t index = begin; index < end; ++index)
+    {
+        const Slot &slot = slots[index & mask];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before != 2 * index + 2)
+            continue;
+
+        TraceEvent event{slot.trace_id.load(std::memory_order_relaxed), slot.timestamp.load(std::memory_order_relaxed),
+                         slot.detail.load(std::memory_order_relaxed), static_cast<TraceStage>(slot.stage.load(std::memory_order_relaxed))};
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before)
+            continue;
+
+        traces[event.trace_id].push_back(event);
+    }
+
+    uint64_t origin = UINT64_MAX;
+    for (const auto &trace : traces)
+        for (const auto &event : trace.second)
+            origin = std::min(origin, event.timestamp);
+
+    bool first = true;
+    out << "{\"traceEvents\":[";
+    for (auto &trace : traces)
+    {
+        uint64_t stages[3] = {0, 0, 0};
+        uint64_t header = 0;
+        std::map<uint64_t, uint64_t> enqueued;
+        for (const auto &event : trace.second)
+        {
+            switch (event.stage)
+            {
+            case TraceStage::Read:
+            case TraceStage::Parse:
+            case TraceStage::Route:
+                stages[static_cast<int>(event.stage)] = event.timestamp;
+                break;
+            case TraceStage::Enqueue:
+                enqueued[event.detail] = event.timestamp;
+                break;
+            case TraceStage::WriteComplete:
+                break;
+            case TraceStage::Header:
+                header = event.detail;
+                break;
+            }
+        }
+
+        if (stages[0] && stages[1])
+            write_span(out, first, "parse", trace.first, stages[0], stages[1], origin, 0, header);
+        if (stages[1] && stages[2])
+            write_span(out, first, "route", trace.first, stages[1], stages[2], origin, 0, header);
+        for (const auto &event : trace.second)
+        {
+            if (event.stage == TraceStage::Enqueue && stages[2])
+                write_span(out, first, "enqueue", trace.first, stages[2], event.timestamp, origin, event.detail, header);
+            else if (event.stage == TraceStage::WriteComplete && enqueued.count(event.detail))
+                write_span(out, first, "write", trace.first, enqueued[event.detail], event.timestamp, origin, event.detail, header);
+        }
+    }
+    out << "\n]}\n";
+
+    return traces.size();
+}
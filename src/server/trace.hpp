@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+/**
+ * @brief Stages a traced message passes through
+ */
+enum class TraceStage : uint8_t
+{
+    Read,
+    Parse,
+    Route,
+    Enqueue,
+    WriteComplete,
+    // Trace id the publisher put in the message header, carried as the detail
+    Header
+};
+
+/**
+ * @brief Sampled per-message tracing into a lock-free ring buffer
+ * A trace id of 0 means the message is not sampled, every record site is a single branch on it.
+ * The ring overwrites the oldest events, each slot is guarded by a sequence number so exports
+ * skip slots that are being rewritten.
+ */
+class Tracer
+{
+public:
+    explicit Tracer(size_t capacity);
+
+    void set_sample_every(uint32_t n) { sample_every.store(n, std::memory_order_relaxed); }
+    uint32_t get_sample_every() const { return sample_every.load(std::memory_order_relaxed); }
+    bool enabled() const { return sample_every.load(std::memory_order_relaxed) != 0; }
+
+    /**
+     * @brief Decides whether a new message is traced
+     *
+     * @return uint64_t Trace id, 0 when the message is not sampled
+     */
+    uint64_t begin()
+    {
+        uint32_t n = sample_every.load(std::memory_order_relaxed);
+        if (n == 0)
+            return 0;
+        return sample(n);
+    }
+
+    void record(uint64_t trace_id, TraceStage stage, uint64_t detail = 0, uint64_t timestamp = 0);
+    size_t export_chrome_json(std::ostream &out) const;
+
+    static uint64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<uint64_t> trace_id{0};
+        std::atomic<uint64_t> timestamp{0};
+        std::atomic<uint64_t> detail{0};
+        std::atomic<uint8_t> stage{0};
+    };
+
+    uint64_t sample(uint32_t n);
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> counter{0};
+    std::atomic<uint64_t> next_id{0};
+    std::atomic<uint32_t> sample_every{0};
+};
@@ -0,0 +1,232 @@
+#include "websocket.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+/**
+ * @brief Reads the head of an HTTP request
+ *
+ * @param socket Accepted connection
+ * @param request Parsed request line and headers
+ * @param leftover Bytes received after the head, the first frames of an eager client
+ * @return true Request head was read
+ * @return false Connection closed, head too long or malformed
+ */
+bool read_http_request(boost::asio::ip::tcp::socket &socket, HttpRequest &request, std::string &leftover)
+{
+    std::string head;
+    size_t end;
+    char data[1024];
+    while ((end = head.find("\r\n\r\n")) == std::string::npos)
+    {
+        if (head.size() > MAX_HTTP_HEADER_LENGTH)
+            return false;
+
+        boost::system::error_code error;
+        size_t length = socket.read_some(boost::asio::buffer(data), error);
+        if (error)
+            return false;
+        head.append(data, length);
+    }
+    leftover = head.substr(end + 4);
+    head.resize(end);
+
+    std::istringstream lines(head);
+    std::string line;
+    std::getline(lines, line);
+    std::istringstream request_line(line);
+    if (!(request_line >> request.method >> request.path))
+        return false;
+
+    while (std::getline(lines, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c)
+                       { return std::tolower(c); });
+        size_t value = line.find_first_not_of(' ', colon + 1);
+        request.headers[name] = value == std::string::npos ? "" : line.substr(value);
+    }
+    return true;
+}
+
+/**
+ * @brief Checks whether a request asks for a WebSocket upgrade
+ *
+ * @param request Parsed request
+ */
+bool is_websocket_upgrade(const HttpRequest &request)
+{
+    auto upgrade = request.headers.find("upgrade");
+    if (request.method != "GET" || upgrade == request.headers.end() || !request.headers.count("sec-websocket-key"))
+        return false;
+
+    std::string value = upgrade->second;
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    return value == "websocket";
+}
+
+/**
+ * @brief Builds the 101 response accepting a WebSocket upgrade
+ *
+ * @param request Upgrade request
+ * @return std::string HTTP response head
+ */
+std::string websocket_handshake_response(const HttpRequest &request)
+{
+    std::string key = request.headers.at("sec-websocket-key") + WEBSOCKET_GUID;
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char *>(key.data()), key.size(), digest);
+
+    unsigned char accept[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+    EVP_EncodeBlock(accept, digest, SHA_DIGEST_LENGTH);
+
+    return "HTTP/1.1 101 Switching Protocols\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: Upgrade\r\n"
+           "Sec-WebSocket-Accept: " +
+           std::string(reinterpret_cast<char *>(accept)) + "\r\n\r\n";
+}
+
+/**
+ * @brief Encodes an unmasked server frame
+ *
+ * @param payload Message
+ * @param opcode Frame type
+ * @return std::string Frame ready to be written
+ */
+std::string websocket_frame(const std::string &payload, WebSocketOpcode opcode)
+{
+    std::string frame;
+    frame.reserve(payload.size() + 10);
+    frame += static_cast<char>(0x80 | static_cast<uint8_t>(opcode));
+
+    size_t length = payload.size();
+    if (length < 126)
+    {
+        frame += static_cast<char>(length);
+    }
+    else if (length <= 0xFFFF)
+    {
+        frame += static_cast<char>(126);
+        frame += static_cast<char>(length >> 8);
+        frame += static_cast<char>(length & 0xFF);
+    }
+    else
+    {
+        frame += static_cast<char>(127);
+        for (int shift = 56; shift >= 0; shift -= 8)
+            frame += static_cast<char>((static_cast<uint64_t>(length) >> shift) & 0xFF);
+    }
+
+    frame += payload;
+    return frame;
+}
+
+/**
+ * @brief Construct a new WebSocket Reader
+ *
+ * @param max_message Largest reassembled message, bigger ones fail the connection
+ */
+WebSocketReader::WebSocketReader(size_t max_message) : max_message(max_message)
+{
+}
+
+/**
+ * @brief Appends received bytes
+ *
+ * @param data Received bytes
+ * @param length Number of bytes
+ */
+void WebSocketReader::feed(const char *data, size_t length)
+{
+    buffer.append(data, length);
+}
+
+/**
+ * @brief Returns the next complete message or control frame
+ *
+ * @param opcode Text, Binary, Close, Ping or Pong
+ * @param payload Unmasked payload
+ * @return true A message was returned
+ * @return false More bytes are needed or the stream failed
+ */
+bool WebSocketReader::next(WebSocketOpcode &opcode, std::string &payload)
+{
+    while (!error)
+    {
+        if (buffer.size() < 2)
+            return false;
+
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(buffer.data());
+        bool fin = bytes[0] & 0x80;
+        auto frame_opcode = static_cast<WebSocketOpcode>(bytes[0] & 0x0F);
+        bool masked = bytes[1] & 0x80;
+        uint64_t length = bytes[1] & 0x7F;
+        size_t header = 2;
+
+        if (length == 126)
+        {
+            if (buffer.size() < 4)
+                return false;
+            length = (static_cast<uint64_t>(bytes[2]) << 8) | bytes[3];
+            header = 4;
+        }
+        else if (length == 127)
+        {
+            if (buffer.size() < 10)
+                return false;
+            length = 0;
+            for (int i = 2; i < 10; ++i)
+                length = (length << 8) | bytes[i];
+            header = 10;
+        }
+
+        // Clients must mask, oversized messages are refused before they are buffered
+        if (!masked || length > max_message || message.size() + length > max_message)
+        {
+            error = true;
+            return false;
+        }
+
+        if (buffer.size() < header + 4 + length)
+            return false;
+
+        const unsigned char *mask = bytes + header;
+        std::string data = buffer.substr(header + 4, length);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] ^= mask[i % 4];
+        buffer.erase(0, header + 4 + length);
+
+        if (static_cast<uint8_t>(frame_opcode) >= static_cast<uint8_t>(WebSocketOpcode::Close))
+        {
+            opcode = frame_opcode;
+            payload = std::move(data);
+            return true;
+        }
+
+        if (frame_opcode != WebSocketOpcode::Continuation)
+            message_opcode = frame_opcode;
+        message += data;
+
+        if (fin)
+        {
+            opcode = message_opcode;
+            payload = std::move(message);
+            message.clear();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <boost/asio.hpp>
+
+// Magic value of RFC 6455 mixed into the handshake key
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+// Largest request head accepted before the upgrade
+#define MAX_HTTP_HEADER_LENGTH 8192
+
+enum class WebSocketOpcode : uint8_t
+{
+    Continuation = 0x0,
+    Text = 0x1,
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xA,
+};
+
+/**
+ * @brief Request line and headers of an HTTP request, header names are lower case
+ */
+struct HttpRequest
+{
+    std::string method;
+    std::string path;
+    std::unordered_map<std::string, std::string> headers;
+};
+
+bool read_http_request(boost::asio::ip::tcp::socket &socket, HttpRequest &request, std::string &leftover);
+bool is_websocket_upgrade(const HttpRequest &request);
+std::string websocket_handshake_response(const HttpRequest &request);
+std::string websocket_frame(const std::string &payload, WebSocketOpcode opcode);
+
+/**
+ * @brief Incremental parser of masked client frames
+ * Fragmented messages are reassembled, control frames are returned as soon as they are complete
+ */
+class WebSocketReader
+{
+public:
+    explicit WebSocketReader(size_t max_message);
+
+    void feed(const char *data, size_t length);
+    bool next(WebSocketOpcode &opcode, std::string &payload);
+    bool failed() const { return error; }
+
+private:
+    size_t max_message;
+    std::string buffer;
+    std::string message;
+    WebSocketOpcode message_opcode = WebSocketOpcode::Text;
+    bool error = false;
+};